@@ -0,0 +1,170 @@
+"""
+benchmarks of the Python binding on the unix port: decodes test/test.mp3 once
+for each way of driving mplibmad.Decoder, and prints for each
+
+- fps: frames per second for the whole decode, callbacks included
+- us/frame: the same, as microseconds per frame
+- bytes/frame: heap allocated per frame in the steady state, from
+  gc.mem_alloc() with the collector off, so a binding that starts allocating
+  per frame (a dict, a bytearray, a wrapper) shows up here first
+- in_us, out_us: microseconds per call spent inside the input and output
+  callbacks, measured from Python, so they include get_pcm() and friends
+- in_ticks, out_ticks: ticks per call of the same callbacks measured by the
+  decoder, which adds the cost of calling them, when it's built with
+  -DMAD_STATS (see Decoder.stats())
+
+Run by `make test` after test.py; `micropython bench.py -o bench_py.json`
+also writes the results as JSON, for comparing from change to change like
+host/bench.json (which times libmad on its own, without any of this).
+
+The styles:
+- buffer: from_buffer() and an output callback that does nothing, the floor
+- buffer-pcm: the same, calling get_pcm() for every frame
+- buffer-header: the same, calling get_frame_header() for every frame
+- input: an input callback reading the file with readinto()
+- input-pcm: the input callback and get_pcm(), decode.py without the wav
+- pipeline: from_buffer() through pipeline.run(decoder, 2), with get_pcm()
+"""
+try:
+    import mplibmad_x64 as mplibmad # type: ignore
+except ImportError:
+    import mplibmad # type: ignore
+
+import gc
+import sys
+import time
+import micropython
+
+FILE = "test/test.mp3"
+WARMUP = 32       # frames before the allocation window, for the state allocated on the first header
+ALLOC_FRAMES = 256
+
+
+class Run:
+    # the cb_data of every style: counters, and what the output callback does
+    def __init__(self, source=None, pcm=False, header=False, limit=0):
+        self.source = source
+        self.pcm = pcm
+        self.header = header
+        self.limit = limit  # stop after this many frames, 0 for the whole file
+        self.frames = 0
+        self.in_calls = 0
+        self.in_us = 0
+        self.out_us = 0
+        self.alloc_start = 0
+        self.alloc_end = 0
+
+def input_callback(decoder, run, buffer):
+    t = time.ticks_us()
+    n = run.source.readinto(buffer)
+    run.in_calls += 1
+    run.in_us += time.ticks_diff(time.ticks_us(), t)
+    return n
+
+def output_callback(decoder, run):
+    t = time.ticks_us()
+    if run.pcm:
+        decoder.get_pcm()
+    if run.header:
+        decoder.get_frame_header()
+    run.frames += 1
+    run.out_us += time.ticks_diff(time.ticks_us(), t)
+
+    if run.limit:
+        if run.frames == WARMUP:
+            run.alloc_start = gc.mem_alloc()
+        elif run.frames == run.limit:
+            run.alloc_end = gc.mem_alloc()
+            return mplibmad.MAD_FLOW_STOP
+    return mplibmad.MAD_FLOW_CONTINUE
+
+def decode(style, mp3, limit=0):
+    name, streamed, pcm, header, pipelined = style
+    f = open(FILE, "rb") if streamed else None
+    run = Run(f, pcm, header, limit)
+    if streamed:
+        decoder = mplibmad.Decoder(cb_data=run, input=input_callback, output=output_callback)
+    else:
+        decoder = mplibmad.Decoder(cb_data=run, output=output_callback)
+        decoder.from_buffer(mp3)
+
+    gc.collect()
+    if limit:
+        gc.disable()
+    start = time.ticks_us()
+    try:
+        if pipelined:
+            import pipeline
+            result = pipeline.run(decoder, 2)
+        else:
+            result = decoder.run()
+    finally:
+        elapsed = time.ticks_diff(time.ticks_us(), start)
+        gc.enable()
+        if f:
+            f.close()
+    assert result == 0, "decoding should succeed"
+    return run, decoder, elapsed
+
+# name, input callback, get_pcm, get_frame_header, pipeline
+STYLES = (
+    ("buffer",        False, False, False, False),
+    ("buffer-pcm",    False, True,  False, False),
+    ("buffer-header", False, False, True,  False),
+    ("input",         True,  False, False, False),
+    ("input-pcm",     True,  True,  False, False),
+    ("pipeline",      False, True,  False, True),
+)
+
+def bench(style, mp3):
+    # one pass over the whole file for the times, one short one for the heap
+    run, decoder, elapsed = decode(style, mp3)
+    frames = run.frames
+    result = {
+        'style': style[0],
+        'frames': frames,
+        'fps': frames * 1000000 // elapsed,
+        'us_frame': elapsed // frames,
+        'in_us': run.in_us // run.in_calls if run.in_calls else 0,
+        'out_us': run.out_us // frames,
+    }
+    stats = decoder.stats()
+    if stats:
+        for stage, key in (('input', 'in_ticks'), ('output', 'out_ticks')):
+            total, worst, count = stats[stage]
+            result[key] = total // count if count else 0
+
+    run, decoder, elapsed = decode(style, mp3, WARMUP + ALLOC_FRAMES)
+    result['bytes_frame'] = (run.alloc_end - run.alloc_start) // ALLOC_FRAMES
+    return result
+
+def write_json(path, results):
+    import json
+    with open(path, "w") as f:
+        json.dump({'file': FILE, 'results': results}, f)
+
+def main():
+    out = None
+    if len(sys.argv) > 2 and sys.argv[1] == "-o":
+        out = sys.argv[2]
+
+    with open(FILE, "rb") as f:
+        mp3 = f.read()
+
+    results = []
+    for style in STYLES:
+        results.append(bench(style, mp3))
+
+    print(f"Bench: {FILE}")
+    print("style             fps  us/frame  bytes/frame  in_us  out_us  in_ticks  out_ticks")
+    for r in results:
+        print("%-14s %6d  %8d  %11d  %5d  %6d  %8s  %9s" % (
+            r['style'], r['fps'], r['us_frame'], r['bytes_frame'], r['in_us'], r['out_us'],
+            r.get('in_ticks', '-'), r.get('out_ticks', '-')))
+    micropython.mem_info()
+
+    if out:
+        write_json(out, results)
+
+if __name__ == "__main__":
+    main()
@@ -109,31 +109,14 @@ def output_callback(decoder, data):
     pcm = decoder.get_pcm()
 
     if first_write:
-        dest.setnchannels(pcm['channels'])
-        dest.setframerate(pcm['samplerate'])
-        dest.setsampwidth(pcm['width']) # 2 for 16-bit samples
-        print(f"width: array len={len(pcm['left'])} sample count={pcm['length']} width={pcm['width']}")
-        print(f"channels={pcm['channels']} samplerate={pcm['samplerate']} length={pcm['length']}")
-    
-    # Interleave the left and right channel samples into an output frame
-    frame = bytearray(pcm['channels'] * pcm['width'] * pcm['length'])
-    sample_num = 0 # increments per sample
-    while sample_num < pcm['length']:
-        pcm_idx = sample_num * pcm['width']
-        frame_idx = sample_num * pcm['channels'] * pcm['width']
-        
-        sample_num += 1
-
-        # write out 16-bit little endian pcm samples
-        frame[frame_idx+0] = pcm['left'][pcm_idx+0]
-        frame[frame_idx+1] = pcm['left'][pcm_idx+1]
-
-        # if stereo, write right channel sample
-        if pcm['channels'] > 1:
-            frame[frame_idx+2] = pcm['right'][pcm_idx+0]
-            frame[frame_idx+3] = pcm['right'][pcm_idx+1]
-
-    dest.writeframes(frame)
+        dest.setnchannels(pcm.channels)
+        dest.setframerate(pcm.samplerate)
+        dest.setsampwidth(pcm.width) # 2 for 16-bit samples
+        print(f"width: array len={len(pcm.left)} sample count={pcm.length} width={pcm.width}")
+        print(f"channels={pcm.channels} samplerate={pcm.samplerate} length={pcm.length}")
+
+    # the left and right channel samples interleaved into an output frame, 16-bit little endian
+    dest.writeframes(pcm.interleaved)
     first_write = False
     return mplibmad.MAD_FLOW_CONTINUE
 
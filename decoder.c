@@ -19,6 +19,7 @@
  * $Id: decoder.c,v 1.22 2004/01/23 09:41:32 rob Exp $
  */
 #include "libmad/mad.h"
+#include "libmad/layer3.h"
 #include "decoder.h"
 
 
@@ -33,67 +34,432 @@ int input_cb(mp_obj_libmad_decoder_t *decoder, unsigned char *buf, int room) {
   args[1] = decoder->cb_data;
   args[2] = tmpbuf;
 
+  MAD_STATS_START(t);
   mp_obj_t result = mp_call_function_n_kw(decoder->py_input_cb, 3, 0, args);
+  MAD_STATS_STOP(&decoder->stats, MAD_STAGE_INPUT, t);
   int bytesread = mp_obj_get_int(result);
   
   return bytesread;
 }
 
-// Source - https://stackoverflow.com/a/43255382
-// Posted by Jeroen
-// Retrieved 2026-02-15, License - CC BY-SA 3.0
+/*
+ * Decoding straight from a caller's buffer (Decoder.from_buffer): the stream
+ * reads the caller's memory in place, libmad only ever reads from its input,
+ * so read-only bytes in flash are fine. Nothing is copied except the Layer III
+ * bit reservoir, and the last partial frame, which is moved into mp3buf with
+ * MAD_BUFFER_GUARD zero bytes after it so the final frame decodes too.
+ */
+static enum mad_flow get_source_input(mp_obj_libmad_decoder_t *decoder) {
+  struct mad_stream *stream = &decoder->stream;
+  mp_buffer_info_t bufinfo;
+
+  mp_get_buffer_raise(decoder->source, &bufinfo, MP_BUFFER_READ);
+
+  if (stream->buffer == bufinfo.buf) {
+    // ran off the end of the caller's buffer, decode the rest from ours
+    int keep = stream->next_frame ? stream->bufend - stream->next_frame : 0;
+    if (keep > decoder->ring_size - MAD_BUFFER_GUARD) {
+      keep = decoder->ring_size - MAD_BUFFER_GUARD;
+    }
+
+    memcpy(decoder->mp3buf, stream->bufend - keep, keep);
+    memset(decoder->mp3buf + keep, 0, MAD_BUFFER_GUARD);
+    mad_stream_buffer(stream, decoder->mp3buf, keep + MAD_BUFFER_GUARD);
+    return MAD_FLOW_CONTINUE;
+  }
+
+  if (stream->bufend == stream->buffer) {
+    // first call since the reset
+    mad_stream_buffer(stream, (unsigned char *)bufinfo.buf, bufinfo.len);
+    return MAD_FLOW_CONTINUE;
+  }
+
+  // the tail has been decoded too
+  return MAD_FLOW_STOP;
+}
+
+// whether the frame being decoded starts before source_first, so it only
+// brings the decoder state up to date for the frames that follow, see
+// split() in module.c
+static bool warming_up(mp_obj_libmad_decoder_t *decoder) {
+  struct mad_stream *stream = &decoder->stream;
+  mp_buffer_info_t bufinfo;
+  size_t rest;
+
+  if (decoder->source == MP_OBJ_NULL || decoder->source_first == 0) {
+    return false;
+  }
+  mp_get_buffer_raise(decoder->source, &bufinfo, MP_BUFFER_READ);
+
+  // the tail is decoded from a copy in mp3buf, with the guard bytes after it
+  rest = stream->bufend - stream->this_frame;
+  if (stream->buffer != bufinfo.buf) {
+    rest -= MAD_BUFFER_GUARD;
+  }
+
+  return bufinfo.len - rest < decoder->source_first;
+}
+
+/*
+ * Input ring
+ *
+ * mp3buf is a ring of ring_size bytes, followed by a mirror of up to
+ * MP3_MIRROR_SIZE bytes of its start. Data is never slid down: the input
+ * callback is handed the free span(s) of the ring to read into, and the
+ * stream is pointed at the unread data from ring_read on. When that data
+ * wraps, only as much of the start of the ring as the frame straddling the
+ * end needs (stream->need) is copied into the mirror, so libmad always sees
+ * whole frames contiguously.
+ *
+ * With a block_size, the callback is only asked for whole blocks at block
+ * aligned offsets (the ring size is a multiple of it), so an SD card sees
+ * whole sector reads. With a low_water mark, the ring is topped up between
+ * frames whenever the unread data drops below it, rather than only when a
+ * frame runs off the end of the data.
+ */
+static void ring_mirror(mp_obj_libmad_decoder_t *decoder) {
+  unsigned int const size = decoder->ring_size;
+  unsigned int const end = decoder->ring_read + decoder->stream.need;
+  unsigned int wrapped = decoder->ring_read + decoder->ring_fill;
+  unsigned int want;
+
+  // nothing wraps, or libmad hasn't run into the end of the ring yet
+  if (wrapped <= size || end <= size) {
+    return;
+  }
+  wrapped -= size;
+
+  want = end - size;
+  if (want > wrapped) want = wrapped;
+  if (want > MP3_MIRROR_SIZE) want = MP3_MIRROR_SIZE;
+
+  if (want > decoder->ring_mirrored) {
+    memcpy(decoder->mp3buf + size + decoder->ring_mirrored,
+           decoder->mp3buf + decoder->ring_mirrored, want - decoder->ring_mirrored);
+    decoder->ring_mirrored = want;
+  }
+}
+
+// true if the ring should be topped up before the next frame
+static bool ring_low(mp_obj_libmad_decoder_t *decoder) {
+  struct mad_stream *stream = &decoder->stream;
+
+  return decoder->source == MP_OBJ_NULL && !decoder->ring_eof &&
+    decoder->ring_fill - (stream->next_frame - stream->buffer) < decoder->low_water;
+}
 
 static enum mad_flow get_input(mp_obj_libmad_decoder_t *decoder) {
+  struct mad_stream *stream = &decoder->stream;
+  unsigned char *ring = decoder->mp3buf;
+  unsigned int const size = decoder->ring_size;
+  unsigned int const block = decoder->block_size;
+
+  if (decoder->source != MP_OBJ_NULL) {
+    return get_source_input(decoder);
+  }
+
+  // forget what libmad has finished with
+  unsigned int consumed = stream->next_frame - stream->buffer;
+  unsigned int span = stream->bufend - stream->buffer;
+
+  decoder->ring_fill -= consumed;
+  decoder->ring_read += consumed;
+  if (decoder->ring_read >= size) {
+    // back at the start of the ring, the mirror is free again
+    decoder->ring_read -= size;
+    decoder->ring_mirrored = 0;
+  }
+
+  // read into the free span up to the end of the ring, then the one at its start
+  while (!decoder->ring_eof && decoder->ring_fill < size) {
+    unsigned int write = (decoder->ring_read + decoder->ring_fill) % size;
+    unsigned int room = size - decoder->ring_fill;
+    if (write + room > size) {
+      room = size - write;
+    }
+    if (block > 1) {
+      // whole blocks only, or just up to the next block boundary after a short read
+      unsigned int head = write % block;
+      room = head ? (room < block - head ? room : block - head) : room - room % block;
+      if (room == 0) {
+        break;
+      }
+    }
+
+    int bytesread = input_cb(decoder, ring + write, room);
 
-  int retval; /* Return value from read(). */
-  int len; /* Length of the new buffer. */
-  int eof; /* Whether this is the last buffer that we can provide. */
-
-  // move any remaining data to the begining of the stream, tell me how many bytes i can fit in the buffer.
-  int keep = mad_stream_advance_frame(&decoder->stream);
-  int room = MP3_BUF_SIZE - keep;
-
-  /* Append new data to the buffer. */
-  int bytesread = input_cb(decoder, decoder->stream.buffer + keep, room);
-
-  //mp_printf(&mp_plat_print, "mad_decoder_run: input %d\n", bytesread);
-
-  if (bytesread < 0) {
-    /* Read error. */
-    mp_printf(&mp_plat_print, "mad_decoder_run: READ ERROR (%d)\n", bytesread);
-    return MAD_FLOW_STOP;
-  } else if (bytesread == 0) {
-    mp_printf(&mp_plat_print, "mad_decoder_run: EOF keep=%d, bytesread=%d\n", keep, bytesread);
-
-    /* End of file. Append MAD_BUFFER_GUARD zero bytes to make sure that the
-    last frame is properly decoded. */
-    if (keep + MAD_BUFFER_GUARD <= MP3_BUF_SIZE) {
-      /* Append all guard bytes and stop decoding after this buffer. */
-      memset(decoder->mp3buf + keep, 0, MAD_BUFFER_GUARD);
-      len = keep + MAD_BUFFER_GUARD;
-      mad_stream_buffer(&decoder->stream, decoder->mp3buf, len);
-      mp_printf(&mp_plat_print, "mad_decoder_run: returning MAD_FLOW_STOP\n");
+    // the read error and end of file handling, with its guard bytes, is adapted from
+    // Source - https://stackoverflow.com/a/43255382
+    // Posted by Jeroen
+    // Retrieved 2026-02-15, License - CC BY-SA 3.0
+    if (bytesread < 0) {
+      /* Read error. */
+      mp_printf(&mp_plat_print, "mad_decoder_run: READ ERROR (%d)\n", bytesread);
       return MAD_FLOW_STOP;
-    } else {
-      /* The guard bytes don't all fit in our buffer, so we need to continue
-      decoding and write all of the guard bytes in the next call to input(). */
-      memset(decoder->mp3buf + keep, 0, MP3_BUF_SIZE - keep);
-      len = MP3_BUF_SIZE;
-      mad_stream_buffer(&decoder->stream, decoder->mp3buf, len);
-      return MAD_FLOW_CONTINUE;
+    } else if (bytesread == 0) {
+      /* End of file. Append MAD_BUFFER_GUARD zero bytes to make sure that the
+      last frame is properly decoded, and stop once it has been. If they don't
+      fit yet, try again after libmad has used up some more of the ring. */
+      if (decoder->ring_fill + MAD_BUFFER_GUARD <= size) {
+        mp_printf(&mp_plat_print, "mad_decoder_run: EOF, %d bytes left\n", decoder->ring_fill);
+        for (int i = 0; i < MAD_BUFFER_GUARD; i++) {
+          ring[(write + i) % size] = 0;
+        }
+        decoder->ring_fill += MAD_BUFFER_GUARD;
+        decoder->ring_eof = true;
+      }
+      break;
+    }
+    // End Attribution
+
+    decoder->ring_fill += bytesread;
+    if ((unsigned int)bytesread < room) {
+      // short read, that's all there is for now
+      break;
     }
   }
-  
-  /* New buffer length is amount of bytes that we kept from the previous
-  buffer plus the bytes that we read just now. */
-  len = keep + bytesread;
 
-  /* Pass the new buffer information to libmad. */
-  mad_stream_buffer(&decoder->stream, decoder->mp3buf, len);
+  ring_mirror(decoder);
+  stream->need = 0;
+
+  unsigned int len = decoder->ring_fill;
+  if (decoder->ring_read + len > size + decoder->ring_mirrored) {
+    len = size + decoder->ring_mirrored - decoder->ring_read;
+  }
+
+  if (consumed == 0 && len <= span) {
+    if (decoder->ring_eof) {
+      // the last frame has been decoded along with the guard bytes
+      return MAD_FLOW_STOP;
+    }
+    // the ring is full and libmad still can't decode a frame from it
+    mp_printf(&mp_plat_print, "mad_decoder_run: frame larger than the input buffer\n");
+    return MAD_FLOW_BREAK;
+  }
+
+  /* Pass the unread data to libmad. */
+  mad_stream_buffer(stream, ring + decoder->ring_read, len);
 
   return MAD_FLOW_CONTINUE;
 }
-// End Attribution
+
+/*
+ * Decoder state
+ *
+ * The big per-channel arrays of the stream, frame and synth structs are not
+ * part of the Decoder object. They live in one block allocated by
+ * decoder_state_fit() once the first header is known, so a mono stream only
+ * pays for one channel, and Layer I/II streams skip the Layer III overlap
+ * and main_data reservoir. Block layout, in order:
+ *
+ *   sbsample   nch * 36 * 32 mad_fixed_t
+ *   filter     nch * 2 * 2 * 16 * 8 mad_fixed_t
+ *   overlap    nch * 32 * 18 mad_fixed_t     (Layer III only)
+ *   pcm        nch * 1152 signed short
+ *   main_data  MAD_BUFFER_MDLEN bytes        (Layer III only)
+ *
+ * Arenas
+ *
+ * Instead of the heap, the caller can hand the decoder up to
+ * DECODER_ARENAS_MAX buffers to use, e.g. fast SRAM first and slow PSRAM
+ * last. The input ring is taken from the end of the last
+ * arena when the decoder is created. The state parts are then placed in the
+ * order above, hottest first, each at the next DECODER_ARENA_ALIGN boundary
+ * of the current arena, moving on to the next arena when a part doesn't fit.
+ * A single arena of footprint total + mp3buf + DECODER_ARENA_ALIGN - 1
+ * bytes is always enough, whatever its alignment: every part but the last
+ * is a multiple of DECODER_ARENA_ALIGN bytes, so only the first one is
+ * padded.
+ * Nothing is allocated on the heap, and a stream whose state doesn't fit
+ * fails to decode with MAD_ERROR_NOMEM.
+ */
+enum { PART_SBSAMPLE, PART_FILTER, PART_OVERLAP, PART_PCM, PART_MAIN_DATA, PART_COUNT };
+
+void decoder_footprint(decoder_footprint_t *fp, bool layer3, unsigned int nch, unsigned int ring_size) {
+  fp->sbsample  = nch * sizeof(mad_fixed_t [36][32]);
+  fp->filter    = nch * sizeof(mad_fixed_t [2][2][16][8]);
+  fp->overlap   = layer3 ? nch * sizeof(mad_fixed_t [32][18]) : 0;
+  fp->pcm       = nch * sizeof(signed short [1152]);
+  fp->main_data = layer3 ? MAD_BUFFER_MDLEN : 0;
+  fp->total     = fp->sbsample + fp->filter + fp->overlap + fp->pcm + fp->main_data;
+  fp->mp3buf    = ring_size + MP3_MIRROR_SIZE;
+}
+
+// take the arenas, and the input buffer (ring_size must be set) from the end of the last one.
+// returns false if the last arena is too small for the input buffer.
+bool decoder_arena_init(mp_obj_libmad_decoder_t *decoder, unsigned char *const base[], size_t const size[], unsigned int count) {
+  size_t alloc = decoder->ring_size + MP3_MIRROR_SIZE;
+
+  if (count == 0 || count > DECODER_ARENAS_MAX || size[count - 1] < alloc) {
+    return false;
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    decoder->arena[i].base = base[i];
+    decoder->arena[i].size = size[i];
+  }
+  decoder->n_arenas = count;
+
+  decoder->arena[count - 1].size -= alloc;
+  decoder->mp3buf = base[count - 1] + decoder->arena[count - 1].size;
+
+  return true;
+}
+
+// work out where each part of the state goes for this mode, returns false if it doesn't fit
+static bool decoder_state_layout(mp_obj_libmad_decoder_t *decoder, bool layer3, unsigned int nch,
+                                 unsigned char *part[PART_COUNT]) {
+  decoder_footprint_t fp;
+  decoder_footprint(&fp, layer3, nch, decoder->ring_size);
+
+  size_t const size[PART_COUNT] = { fp.sbsample, fp.filter, fp.overlap, fp.pcm, fp.main_data };
+  unsigned int a = 0;
+  size_t used = 0;
+
+  for (int i = 0; i < PART_COUNT; i++) {
+    part[i] = NULL;
+    if (size[i] == 0) {
+      continue;
+    }
+
+    if (decoder->n_arenas == 0) {
+      // one after another in the heap block
+      part[i] = (unsigned char *)decoder->state + used;
+      used += size[i];
+      continue;
+    }
+
+    for (; a < decoder->n_arenas; a++, used = 0) {
+      decoder_arena_t *arena = &decoder->arena[a];
+      size_t pad = -(uintptr_t)(arena->base + used) & (DECODER_ARENA_ALIGN - 1);
+
+      if (used + pad + size[i] <= arena->size) {
+        part[i] = arena->base + used + pad;
+        used += pad + size[i];
+        break;
+      }
+    }
+    if (part[i] == NULL) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// point the stream, frame and synth at their parts of the state
+static void decoder_state_attach(mp_obj_libmad_decoder_t *decoder) {
+  unsigned int nch = decoder->state_nch;
+  unsigned char *part[PART_COUNT];
+
+  if (nch == 0 || !decoder_state_layout(decoder, decoder->state_layer3, nch, part)) {
+    return;
+  }
+
+  mad_stream_attach(&decoder->stream, part[PART_MAIN_DATA]);
+  mad_frame_attach(&decoder->frame, nch, (void *)part[PART_SBSAMPLE], (void *)part[PART_OVERLAP]);
+  mad_synth_attach(&decoder->synth, nch, (void *)part[PART_FILTER], (void *)part[PART_PCM]);
+
+  if (decoder->pipe != NULL) {
+    // the back stage finishes frames into the same sbsample and overlap
+    mad_frame_attach(&decoder->pipe->frame, nch, (void *)part[PART_SBSAMPLE], (void *)part[PART_OVERLAP]);
+    decoder->pipe->sbsample = (void *)part[PART_SBSAMPLE];
+  }
+}
+
+// make sure there is state big enough for layer3 and nch, growing it if needed.
+// The state is never shrunk, and growing it starts the synthesis from silence.
+static void decoder_state_grow(mp_obj_libmad_decoder_t *decoder, bool layer3, unsigned int nch) {
+  unsigned char *part[PART_COUNT];
+  decoder_footprint_t fp;
+
+  if (nch <= decoder->state_nch &&
+      (!layer3 || decoder->state_layer3)) {
+    return;
+  }
+
+  if (decoder->state_nch > nch) nch = decoder->state_nch;
+  layer3 = layer3 || decoder->state_layer3;
+
+  if (decoder->n_arenas > 0) {
+    // leave the current state alone if the new one doesn't fit, the frame decode will fail
+    if (!decoder_state_layout(decoder, layer3, nch, part)) {
+      mp_printf(&mp_plat_print, "decoder_state_fit: arenas too small for layer %s, %u channel(s)\n",
+                layer3 ? "III" : "I/II", nch);
+      return;
+    }
+  } else {
+    // the new block first: if that raises MemoryError the old state is still whole
+    decoder_footprint(&fp, layer3, nch, decoder->ring_size);
+    void *state = m_malloc(fp.total);
+
+    if (decoder->state != NULL) {
+      m_free(decoder->state);
+    }
+    decoder->state = state;
+  }
+
+  decoder->state_nch = nch;
+  decoder->state_layer3 = layer3;
+
+  decoder_state_attach(decoder);
+}
+
+static void decoder_state_fit(mp_obj_libmad_decoder_t *decoder, struct mad_header const *header) {
+  decoder_state_grow(decoder, header->layer == MAD_LAYER_III, MAD_NCHANNELS(header));
+}
+
+// the Layer III first stage output or Layer I/II subband samples of a slot
+#define SLOT_DATA(slot) ((unsigned char *)(slot) + ((sizeof(decoder_slot_t) + 7) & ~7))
+
+static decoder_slot_t *pipe_slot(decoder_pipe_t *pipe, unsigned int n) {
+  return (decoder_slot_t *)(pipe->slots + (n % pipe->depth) * pipe->stride);
+}
+
+/*
+ * decode the next frame header, make sure there is state for its layer and
+ * channel count, then decode the rest of the frame. With a slot, only the
+ * pipeline's first stage is run, into the slot.
+ */
+static int decode_frame(mp_obj_libmad_decoder_t *decoder, decoder_slot_t *slot) {
+  struct mad_frame *frame = &decoder->frame;
+  int result;
+
+  if (slot != NULL) {
+    slot->used = false;
+    slot->decoded = false;
+  }
+
+  if (!(frame->header.flags & MAD_FLAG_INCOMPLETE)) {
+    MAD_STATS_START(t);
+    result = mad_header_decode(&frame->header, &decoder->stream);
+    MAD_STATS_STOP(frame->stats, MAD_STAGE_HEADER, t);
+    if (result == -1) {
+      return -1;
+    }
+  }
+
+  decoder_state_fit(decoder, &frame->header);
+
+  if (slot == NULL) {
+    return mad_frame_decode(frame, &decoder->stream);
+  }
+
+  if (frame->header.layer == MAD_LAYER_III) {
+    frame->stage = SLOT_DATA(slot);
+  } else {
+    frame->stage = NULL;
+    frame->sbsample = (void *)SLOT_DATA(slot);
+  }
+
+  result = mad_frame_decode(frame, &decoder->stream);
+
+  slot->header = frame->header;
+  slot->used = true;
+  slot->decoded = (result == 0);
+
+  return result;
+}
 
 static
 enum mad_flow output_cb(mp_obj_libmad_decoder_t *decoder) {
@@ -102,22 +468,25 @@ enum mad_flow output_cb(mp_obj_libmad_decoder_t *decoder) {
   mp_obj_t args[2];
   args[0] = decoder;
   args[1] = decoder->cb_data;
+  MAD_STATS_START(t);
   mp_obj_t result = mp_call_function_n_kw(decoder->py_output_cb, 2, 0, args);
+  MAD_STATS_STOP(&decoder->stats, MAD_STAGE_OUTPUT, t);
   int flow = mp_obj_get_int(result);
 
   //mp_printf(&mp_plat_print, " returning flow=%d\n", flow);
   return (enum mad_flow)flow;
 }
 
+// *mute is set if the frame should be muted before it is synthesized
 static
 enum mad_flow error_default(int *bad_last_frame, struct mad_stream *stream,
-			    struct mad_frame *frame)
+			    bool *mute)
 {
   switch (stream->error) {
   case MAD_ERROR_BADCRC:
     if (*bad_last_frame) {
       mp_printf(&mp_plat_print, "bad CRC, muting frame\n");
-      mad_frame_mute(frame);
+      *mute = true;
     } else {
       *bad_last_frame = 1;
     }
@@ -130,13 +499,13 @@ enum mad_flow error_default(int *bad_last_frame, struct mad_stream *stream,
 }
 
 static
-enum mad_flow error_cb(mp_obj_libmad_decoder_t *decoder, int *bad_last_frame, struct mad_stream *stream, struct mad_frame *frame)
+enum mad_flow error_cb(mp_obj_libmad_decoder_t *decoder, int *bad_last_frame, struct mad_stream *stream, bool *mute)
 {
   //mp_printf(&mp_plat_print, "error_cb: stream->error = %s\n", mad_stream_errorstr(stream));
 
   if (decoder->py_error_cb == MP_OBJ_NULL) {
     // no error callback defined, use default
-    return error_default(bad_last_frame, stream, frame);
+    return error_default(bad_last_frame, stream, mute);
   }
 
   mp_obj_t args[2];
@@ -147,6 +516,179 @@ enum mad_flow error_cb(mp_obj_libmad_decoder_t *decoder, int *bad_last_frame, st
   return mp_obj_get_int(result);
 }
 
+/*
+ * Real time: how long each frame took to decode and synthesize, against how
+ * long it plays for (header->duration). Frames are timed with time.ticks_us
+ * around the decoder's own work, so the input and output callbacks, which
+ * may well block on the card or the audio device, don't count. With the
+ * pipeline it's the back stage's time on the frame, which with split
+ * includes waiting for the right channel, while the front stage is busy
+ * with the frames after it.
+ *
+ * rt_average is a moving average over about 16 frames of the decoding time
+ * over the duration, in 1/1024ths, kept times 16 so the average doesn't lose
+ * the low bits: below 16 << 10 the decoder keeps up. A frame that takes
+ * more than deadline percent of its duration is a miss.
+ */
+#define DECODER_RT_SHIFT    10
+#define DECODER_RT_WEIGHT   4           // log2 of the frames averaged
+#define DECODER_RT_MAX_US   (1UL << 21) // longest frame measured, so the ratio fits 32 bits
+
+// ticks_us wraps at a port specific power of 2, at least 2**30
+#define DECODER_TICKS_MASK  0x3fffffffUL
+
+/*
+ * Governor: when decoding falls behind real time, step down to cheaper
+ * quality levels (DECODER_QUALITY_*) rather than let the output run dry,
+ * and back up once there's headroom. It steps down when rt_average goes
+ * over the deadline and up when it's under DECODER_GOVERNOR_UP percent of
+ * it, and after each step it gives the average time to settle on the new
+ * level, longer before stepping up than down, so it doesn't hunt.
+ */
+#define DECODER_GOVERNOR_UP         50  // percent of the deadline
+#define DECODER_GOVERNOR_HOLD_DOWN  16  // frames after a step before stepping down
+#define DECODER_GOVERNOR_HOLD_UP    64  // frames after a step before stepping up
+
+static void governor(mp_obj_libmad_decoder_t *decoder) {
+  if (decoder->governor == DECODER_QUALITY_FULL) {
+    return;
+  }
+
+  unsigned long average = decoder->rt_average >> DECODER_RT_WEIGHT;
+  unsigned long deadline = ((unsigned long)decoder->deadline << DECODER_RT_SHIFT) / 100;
+  unsigned int frames = ++decoder->quality_frames;
+
+  if (average > deadline && frames >= DECODER_GOVERNOR_HOLD_DOWN &&
+      decoder->quality < decoder->governor) {
+    decoder->quality++;
+    decoder->quality_frames = 0;
+  } else if (average * 100 < deadline * DECODER_GOVERNOR_UP && frames >= DECODER_GOVERNOR_HOLD_UP &&
+             decoder->quality > DECODER_QUALITY_FULL) {
+    decoder->quality--;
+    decoder->quality_frames = 0;
+  }
+}
+
+// libmad options and Layer III subbands for the quality level
+static int quality_options(mp_obj_libmad_decoder_t *decoder) {
+  int options = 0;
+
+  if (decoder->quality >= DECODER_QUALITY_SSO) {
+    options |= MAD_OPTION_SSO;
+  }
+  if (decoder->quality >= DECODER_QUALITY_MONO) {
+    options |= MAD_OPTION_SINGLECHANNEL;
+  }
+  if (decoder->quality >= DECODER_QUALITY_HALFRATE) {
+    options |= MAD_OPTION_HALFSAMPLERATE;
+  }
+  return options;
+}
+
+static unsigned int quality_sblimit(mp_obj_libmad_decoder_t *decoder) {
+  if (decoder->quality >= DECODER_QUALITY_HALFRATE) {
+    return 16;
+  } else if (decoder->quality >= DECODER_QUALITY_SUBBANDS) {
+    return DECODER_SUBBANDS;
+  }
+  return 32;
+}
+
+static mp_uint_t realtime_ticks(mp_obj_libmad_decoder_t *decoder) {
+  return (mp_uint_t)mp_obj_get_int(mp_call_function_n_kw(decoder->py_ticks_us, 0, 0, NULL));
+}
+
+static void realtime_start(mp_obj_libmad_decoder_t *decoder) {
+  if (decoder->deadline) {
+    decoder->rt_start = realtime_ticks(decoder);
+  }
+}
+
+static void realtime_stop(mp_obj_libmad_decoder_t *decoder, struct mad_header const *header) {
+  if (!decoder->deadline) {
+    return;
+  }
+
+  unsigned long us = (realtime_ticks(decoder) - decoder->rt_start) & DECODER_TICKS_MASK;
+  unsigned long duration_us = header->duration.seconds * 1000000UL +
+    header->duration.fraction / (MAD_TIMER_RESOLUTION / 100000) * 10;
+
+  if (duration_us == 0) {
+    return;
+  }
+  if (us > DECODER_RT_MAX_US) {
+    us = DECODER_RT_MAX_US;
+  }
+
+  unsigned long ratio = (us << DECODER_RT_SHIFT) / duration_us;
+  if (decoder->rt_frames == 0) {
+    decoder->rt_average = ratio << DECODER_RT_WEIGHT;
+  } else {
+    decoder->rt_average += ratio - (decoder->rt_average >> DECODER_RT_WEIGHT);
+  }
+
+  if (us > decoder->rt_worst_us) {
+    decoder->rt_worst_us = us;
+  }
+  if (us * 100 > duration_us * decoder->deadline) {
+    decoder->rt_misses++;
+  }
+  decoder->rt_frames++;
+
+  governor(decoder);
+}
+
+/*
+ * NAME:	decoder->reset()
+ * DESCRIPTION:	put the stream, frame and synth back to their initial state
+ *		in place, reusing the state block from a previous track, if any
+ */
+void mad_decoder_reset(mp_obj_libmad_decoder_t *decoder)
+{
+  mad_stream_init(&decoder->stream, decoder->mp3buf);
+  mad_frame_init(&decoder->frame);
+  mad_synth_init(&decoder->synth);
+
+  decoder->ring_read = 0;
+  decoder->ring_fill = 0;
+  decoder->ring_mirrored = 0;
+  decoder->ring_eof = false;
+
+  if (decoder->pipe != NULL) {
+    decoder_pipe_t *pipe = decoder->pipe;
+
+    pipe->head = 0;
+    pipe->tail = 0;
+    pipe->front_input = true;
+    pipe->bad_last_frame = 0;
+    pipe->front_done = false;
+    pipe->front_result = 0;
+    pipe->abort = 0;
+    pipe->back_done = false;
+    pipe->right_req = 0;
+    pipe->right_done = 0;
+    pipe->right_pending = false;
+    mad_frame_init(&pipe->frame);
+  }
+
+  decoder_state_attach(decoder);
+
+#if defined(MAD_STATS)
+  memset(&decoder->stats, 0, sizeof(decoder->stats));
+  decoder->frame.stats = &decoder->stats;
+  mad_ticks_init();
+#endif
+
+  decoder->rt_average = 0;
+  decoder->rt_worst_us = 0;
+  decoder->rt_misses = 0;
+  decoder->rt_frames = 0;
+  decoder->quality_frames = 0;
+
+  // give the stream our buffer, but tell it it doesn't have any data right now.
+  mad_stream_buffer(&decoder->stream, decoder->mp3buf, 0);
+}
+
 /*
  * NAME:	decoder->run()
  * DESCRIPTION:	run the decoder
@@ -159,7 +701,7 @@ int mad_decoder_run(mp_obj_libmad_decoder_t *decoder)
   struct mad_synth *synth;
   int result = 0;
 
-  if (decoder->py_input_cb == MP_OBJ_NULL ||
+  if ((decoder->py_input_cb == MP_OBJ_NULL && decoder->source == MP_OBJ_NULL) ||
       decoder->py_output_cb == MP_OBJ_NULL) {
       mp_printf(&mp_plat_print, "mad_decoder_run: missing required callback(s)\n");
       return 0;
@@ -169,12 +711,7 @@ int mad_decoder_run(mp_obj_libmad_decoder_t *decoder)
   frame  = &decoder->frame;
   synth  = &decoder->synth;
 
-  mad_stream_init(stream, decoder->mp3buf);
-  mad_frame_init(frame);
-  mad_synth_init(synth);
-
-  // give the stream our buffer, but tell it it doesn't have any data right now.
-  mad_stream_buffer(&decoder->stream, decoder->mp3buf, 0);
+  mad_decoder_reset(decoder);
 
   decoder->stream.options = decoder->options;
   do {
@@ -224,19 +761,24 @@ int mad_decoder_run(mp_obj_libmad_decoder_t *decoder)
       }
 #endif
       //mp_printf(&mp_plat_print, "mad_decoder_run: decoding frame\n");
-      int decode_result = mad_frame_decode(frame, stream);
+      realtime_start(decoder);
+      frame->sblimit = quality_sblimit(decoder);
+      int decode_result = decode_frame(decoder, NULL);
       if (decode_result <= -1) {
         //mp_printf(&mp_plat_print, "mad_decoder_run: decode failed... mad_frame_decode = %d\n", decode_result);
         mp_printf(&mp_plat_print, "mad_decoder_run: stream->error = %s\n", mad_stream_errorstr(stream));
         if (!MAD_RECOVERABLE(stream->error))
           break;
 
-        switch (error_cb(decoder, &bad_last_frame, stream, frame)) {
+        bool mute = false;
+        switch (error_cb(decoder, &bad_last_frame, stream, &mute)) {
         case MAD_FLOW_STOP:
           goto done;
         case MAD_FLOW_BREAK:
           goto fail;
         case MAD_FLOW_IGNORE:
+          if (mute)
+            mad_frame_mute(frame);
           break;
         case MAD_FLOW_CONTINUE:
         default:
@@ -261,9 +803,15 @@ int mad_decoder_run(mp_obj_libmad_decoder_t *decoder)
       }
 #endif
       //mp_printf(&mp_plat_print, "mad_decoder_run: synth frame\n");
-      mad_synth_frame(synth, frame);
+      {
+        MAD_STATS_START(t);
+        frame->options |= quality_options(decoder);
+        mad_synth_frame(synth, frame);
+        MAD_STATS_STOP(&decoder->stats, MAD_STAGE_SYNTH, t);
+      }
 
-      if (decoder->py_output_cb != MP_OBJ_NULL) {
+      if (decoder->py_output_cb != MP_OBJ_NULL && !warming_up(decoder)) {
+        realtime_stop(decoder, &frame->header);
         //mp_printf(&mp_plat_print, "mad_decoder_run: output callback\n");
         switch (output_cb(decoder)) {
         case MAD_FLOW_STOP:
@@ -275,6 +823,18 @@ int mad_decoder_run(mp_obj_libmad_decoder_t *decoder)
           break;
         }
       }
+
+      // top the ring up below the low water mark, before a frame runs out of data
+      if (ring_low(decoder)) {
+        switch (get_input(decoder)) {
+        case MAD_FLOW_STOP:
+          goto done;
+        case MAD_FLOW_BREAK:
+          goto fail;
+        default:
+          break;
+        }
+      }
     }
   }
   while (stream->error == MAD_ERROR_BUFLEN);
@@ -290,3 +850,327 @@ int mad_decoder_run(mp_obj_libmad_decoder_t *decoder)
 
   return result;
 }
+
+/*
+ * Pipeline
+ *
+ * Decoding split in two stages that can run on different cores, with a
+ * queue of depth frames between them. The front stage reads the input,
+ * decodes the headers and, for Layer III, the first half of the frame
+ * (scalefactors, Huffman decoding, requantization and joint stereo) into a
+ * slot, see mad_layer_III_stage2(). For Layer I/II it decodes the whole
+ * frame into the slot's subband samples. The back stage finishes the frame
+ * into the persistent sbsample and overlap (IMDCT and overlap-add for Layer
+ * III), synthesizes it and calls the output callback.
+ *
+ * The queue has a single producer and a single consumer: the front stage
+ * only ever advances head and the back stage tail, each publishing with a
+ * release store after it is done with a slot, so no lock is needed.
+ *
+ * A .mpy can't start threads or release the GIL itself, so neither stage
+ * blocks. Each returns DECODER_STAGE_WAIT when it can't go on (queue full
+ * or empty) and is called again by a Python loop, usually the front stage
+ * on a _thread and the back stage on the thread that started decoding, see
+ * pipeline.py. The state is sized for Layer III stereo up front, so it never
+ * moves under the back stage.
+ *
+ * With split set, the back stage also hands the right channel of each
+ * stereo frame to a third stage, STAGE_RIGHT, which finishes and
+ * synthesizes it while the back stage does the left one, the two channels
+ * sharing no state. The back stage waits for it before the output callback.
+ */
+
+// (re)allocate the pipeline with depth slots, 0 to drop it. Returns the
+// bytes allocated, or -1 if the state for the worst case doesn't fit the arenas.
+long mad_decoder_pipeline(mp_obj_libmad_decoder_t *decoder, unsigned int depth, bool split)
+{
+  decoder_pipe_t *pipe;
+  size_t data, stride, head;
+
+  if (decoder->pipe != NULL) {
+    m_free(decoder->pipe);
+    decoder->pipe = NULL;
+  }
+  if (depth == 0) {
+    return 0;
+  }
+
+  data = mad_layer_III_stage_size();
+  if (data < sizeof(mad_fixed_t [2][36][32])) {
+    data = sizeof(mad_fixed_t [2][36][32]);
+  }
+  stride = (SLOT_DATA(0) - (unsigned char *)0) + ((data + 7) & ~7);
+  head = (sizeof(decoder_pipe_t) + 7) & ~7;
+
+  pipe = m_malloc(head + depth * stride);
+  pipe->depth = depth;
+  pipe->stride = stride;
+  pipe->size = head + depth * stride;
+  pipe->slots = (unsigned char *)pipe + head;
+  pipe->split = split;
+  decoder->pipe = pipe;
+
+  decoder_state_grow(decoder, true, 2);
+  if (!decoder->state_layer3 || decoder->state_nch < 2) {
+    m_free(pipe);
+    decoder->pipe = NULL;
+    return -1;
+  }
+
+  mad_decoder_reset(decoder);
+  decoder->stream.options = decoder->options;
+
+  return pipe->size;
+}
+
+// wind both stages down, the back stage returns once the front stage has stopped
+void mad_decoder_abort(mp_obj_libmad_decoder_t *decoder)
+{
+  int none = 0;
+
+  __atomic_compare_exchange_n(&decoder->pipe->abort, &none, MAD_FLOW_BREAK, false,
+                              __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/*
+ * NAME:	decoder->raised()
+ * DESCRIPTION:	clean up after a callback raised out of a stage: stop the
+ *		pipeline, finish the front stage if it was that one, so the
+ *		back stage only drains the queue, and stop counting as running
+ */
+void mad_decoder_raised(mp_obj_libmad_decoder_t *decoder, int stage)
+{
+  decoder_pipe_t *pipe = decoder->pipe;
+
+  mad_decoder_abort(decoder);
+  if (stage == DECODER_STAGE_FRONT) {
+    pipe->front_result = -1;
+    __atomic_store_n(&pipe->front_done, true, __ATOMIC_RELEASE);
+  }
+  decoder->running = false;
+}
+
+/*
+ * NAME:	decoder->front()
+ * DESCRIPTION:	run the front stage until the queue is full, returns
+ *		DECODER_STAGE_WAIT, or 0 / -1 once the input is done
+ */
+int mad_decoder_front(mp_obj_libmad_decoder_t *decoder)
+{
+  decoder_pipe_t *pipe = decoder->pipe;
+  struct mad_stream *stream = &decoder->stream;
+  int result = 0;
+
+  if (__atomic_load_n(&pipe->front_done, __ATOMIC_RELAXED)) {
+    return pipe->front_result;
+  }
+  decoder->running = true;
+
+  while (!__atomic_load_n(&pipe->abort, __ATOMIC_RELAXED)) {
+    if (pipe->front_input) {
+      switch (get_input(decoder)) {
+      case MAD_FLOW_STOP:
+        goto done;
+      case MAD_FLOW_IGNORE:
+        continue;
+      case MAD_FLOW_CONTINUE:
+        break;
+      default:
+        goto fail;
+      }
+      pipe->front_input = false;
+    }
+
+    unsigned int head = pipe->head;
+    if (head - __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE) == pipe->depth) {
+      return DECODER_STAGE_WAIT;
+    }
+
+    decoder_slot_t *slot = pipe_slot(pipe, head);
+    bool mute = false;
+
+    slot->synth = true;
+    if (decode_frame(decoder, slot) == -1) {
+      if (!MAD_RECOVERABLE(stream->error)) {
+        if (stream->error != MAD_ERROR_BUFLEN)
+          goto fail;
+        pipe->front_input = true;
+        continue;
+      }
+
+      switch (error_cb(decoder, &pipe->bad_last_frame, stream, &mute)) {
+      case MAD_FLOW_STOP:
+        goto done;
+      case MAD_FLOW_BREAK:
+        goto fail;
+      case MAD_FLOW_IGNORE:
+        break;
+      case MAD_FLOW_CONTINUE:
+      default:
+        // not output, but the back stage still has to carry the overlap on
+        slot->synth = false;
+        break;
+      }
+    }
+    else
+      pipe->bad_last_frame = 0;
+
+    slot->mute = mute;
+    slot->quiet = warming_up(decoder);
+    if (slot->used) {
+      __atomic_store_n(&pipe->head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    if (ring_low(decoder)) {
+      switch (get_input(decoder)) {
+      case MAD_FLOW_STOP:
+        goto done;
+      case MAD_FLOW_BREAK:
+        goto fail;
+      default:
+        break;
+      }
+    }
+  }
+
+ fail:
+  result = -1;
+
+ done:
+  pipe->front_result = result;
+  __atomic_store_n(&pipe->front_done, true, __ATOMIC_RELEASE);
+
+  return result;
+}
+
+// finish channel ch of a slot, timing it in stats unless that's NULL
+static void back_channel(decoder_pipe_t *pipe, decoder_slot_t *slot, unsigned int ch, struct mad_stats *stats)
+{
+  if (slot->header.layer == MAD_LAYER_III) {
+    MAD_STATS_START(t);
+    mad_layer_III_stage2_channel(&pipe->frame, SLOT_DATA(slot), ch);
+    MAD_STATS_STOP(stats, MAD_STAGE_IMDCT, t);
+  } else if (slot->decoded) {
+    memcpy(pipe->sbsample[ch], (mad_fixed_t (*)[36][32])SLOT_DATA(slot) + ch, sizeof(mad_fixed_t [36][32]));
+  }
+}
+
+/*
+ * NAME:	decoder->back()
+ * DESCRIPTION:	run the back stage until the queue is empty, returns
+ *		DECODER_STAGE_WAIT, or 0 / -1 once both stages are done
+ */
+int mad_decoder_back(mp_obj_libmad_decoder_t *decoder)
+{
+  decoder_pipe_t *pipe = decoder->pipe;
+  struct mad_frame *frame = &pipe->frame;
+  struct mad_stats *stats = decoder->frame.stats;
+  int abort;
+
+  while (1) {
+    unsigned int tail = pipe->tail;
+    decoder_slot_t *slot = pipe_slot(pipe, tail);
+
+    if (pipe->right_pending) {
+      // the left channel is done, waiting for the right one
+      goto right;
+    }
+
+    if (tail == __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE)) {
+      if (!__atomic_load_n(&pipe->front_done, __ATOMIC_ACQUIRE)) {
+        return DECODER_STAGE_WAIT;
+      }
+      // the front stage may have queued a last frame before it finished
+      if (tail == __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      continue;
+    }
+
+    if (__atomic_load_n(&pipe->abort, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&pipe->tail, tail + 1, __ATOMIC_RELEASE);
+      continue;
+    }
+
+    frame->header = slot->header;
+    frame->options = decoder->stream.options | quality_options(decoder);
+    frame->sblimit = quality_sblimit(decoder);
+    realtime_start(decoder);
+
+    if (pipe->split && slot->synth && !slot->mute && MAD_NCHANNELS(&slot->header) == 2 &&
+        (frame->options & MAD_OPTION_SINGLECHANNEL) != MAD_OPTION_SINGLECHANNEL) {
+      __atomic_store_n(&pipe->right_req, tail + 1, __ATOMIC_RELEASE);
+      back_channel(pipe, slot, 0, stats);
+      MAD_STATS_START(t);
+      mad_synth_channel(&decoder->synth, frame, 0);
+      MAD_STATS_STOP(stats, MAD_STAGE_SYNTH, t);
+      pipe->right_pending = true;
+
+    right:
+      if (__atomic_load_n(&pipe->right_done, __ATOMIC_ACQUIRE) != tail + 1) {
+        return DECODER_STAGE_WAIT;
+      }
+      pipe->right_pending = false;
+      mad_synth_advance(&decoder->synth, frame);
+    } else {
+      for (unsigned int ch = 0; ch < MAD_NCHANNELS(&slot->header); ch++) {
+        back_channel(pipe, slot, ch, stats);
+      }
+      if (slot->mute) {
+        mad_frame_mute(frame);
+      }
+      if (slot->synth) {
+        MAD_STATS_START(t);
+        mad_synth_frame(&decoder->synth, frame);
+        MAD_STATS_STOP(stats, MAD_STAGE_SYNTH, t);
+      }
+    }
+
+    bool synth = slot->synth && !slot->quiet;
+    __atomic_store_n(&pipe->tail, tail + 1, __ATOMIC_RELEASE);
+    if (!synth) {
+      continue;
+    }
+    realtime_stop(decoder, &frame->header);
+
+    enum mad_flow flow = output_cb(decoder);
+    if (flow == MAD_FLOW_STOP || flow == MAD_FLOW_BREAK) {
+      // stop the front stage, and drop whatever it has queued
+      int none = 0;
+      __atomic_compare_exchange_n(&pipe->abort, &none, flow, false,
+                                  __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+  }
+
+  decoder->running = false;
+  __atomic_store_n(&pipe->back_done, true, __ATOMIC_RELEASE);
+
+  abort = __atomic_load_n(&pipe->abort, __ATOMIC_RELAXED);
+  if (abort == MAD_FLOW_STOP) {
+    return 0;
+  } else if (abort == MAD_FLOW_BREAK) {
+    return -1;
+  }
+  return pipe->front_result;
+}
+
+/*
+ * NAME:	decoder->right()
+ * DESCRIPTION:	finish and synthesize the right channel of the frame the
+ *		back stage handed over, returns DECODER_STAGE_WAIT, or 0 once
+ *		the back stage is done
+ */
+int mad_decoder_right(mp_obj_libmad_decoder_t *decoder)
+{
+  decoder_pipe_t *pipe = decoder->pipe;
+  unsigned int req = __atomic_load_n(&pipe->right_req, __ATOMIC_ACQUIRE);
+
+  if (req != pipe->right_done) {
+    // not timed, the back stage's thread owns the stats
+    back_channel(pipe, pipe_slot(pipe, req - 1), 1, NULL);
+    mad_synth_channel(&decoder->synth, &pipe->frame, 1);
+    __atomic_store_n(&pipe->right_done, req, __ATOMIC_RELEASE);
+  }
+
+  return __atomic_load_n(&pipe->back_done, __ATOMIC_ACQUIRE) ? 0 : DECODER_STAGE_WAIT;
+}
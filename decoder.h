@@ -15,6 +15,9 @@
 #define MP3_BUF_SIZE 4096
 #define MP3_FRAME_SIZE 2881
 
+// the input ring is followed by room to mirror enough of its start for one frame
+#define MP3_MIRROR_SIZE (MP3_FRAME_SIZE + MAD_BUFFER_GUARD)
+
 enum mad_flow {
   MAD_FLOW_CONTINUE = 0x0000,	/* continue normally */
   MAD_FLOW_STOP     = 0x0010,	/* stop decoding normally */
@@ -25,12 +28,88 @@ enum mad_flow {
 #define mad_decoder_options(decoder, opts)  \
     ((void) ((decoder)->options = (opts)))
 
+// Sizes in bytes of the decoder state that is allocated separately from the
+// object, once the first frame header tells us the layer and channel count.
+typedef struct {
+  size_t sbsample;  // frame.sbsample, every layer
+  size_t filter;    // synth.filter, every layer
+  size_t pcm;       // synth.pcm.samples, every layer
+  size_t overlap;   // frame.overlap, Layer III only
+  size_t main_data; // stream.main_data, Layer III only
+  size_t total;     // all of the above
+  size_t mp3buf;    // input ring, allocated with the object
+} decoder_footprint_t;
+
+// Caller supplied memory for the decoder, see "Arenas" in decoder.c
+#define DECODER_ARENAS_MAX  4
+#define DECODER_ARENA_ALIGN 8
+
+typedef struct {
+  unsigned char *base;
+  size_t size;      // usable bytes, less the input buffer if it was taken from here
+} decoder_arena_t;
+
+// Two stage decoding, see "Pipeline" in decoder.c
+#define DECODER_STAGE_ABORT 0
+#define DECODER_STAGE_FRONT 1
+#define DECODER_STAGE_BACK  2
+#define DECODER_STAGE_RIGHT 3
+
+#define DECODER_STAGE_WAIT  1   // stage result: nothing to do right now, call again
+
+// Quality levels, each cheaper than the one before and including it, see governor() in decoder.c
+#define DECODER_QUALITY_FULL     0
+#define DECODER_QUALITY_SSO      1  // synthesize with MAD_OPTION_SSO
+#define DECODER_QUALITY_SUBBANDS 2  // Layer III: IMDCT only the lower DECODER_SUBBANDS subbands
+#define DECODER_QUALITY_MONO     3  // synthesize stereo frames once, mixed down, into both channels
+#define DECODER_QUALITY_HALFRATE 4  // synthesize at half the sample rate, from the lower 16 subbands
+#define DECODER_QUALITY_LOWEST   DECODER_QUALITY_HALFRATE
+
+#define DECODER_SUBBANDS 20         // up to 13.8 kHz at 44.1 kHz
+
+typedef struct {
+  struct mad_header header;
+  bool used;        // a header was decoded into this slot
+  bool decoded;     // Layer I/II: data holds the frame's subband samples
+  bool mute;        // the error handler muted the frame
+  bool synth;       // synthesize and output the frame, not just update the overlap
+  bool quiet;       // synthesize the frame but don't output it, see warming_up()
+  // followed by the Layer III first stage output, or the Layer I/II subband samples
+} decoder_slot_t;
+
+typedef struct {
+  unsigned int depth;   // slots in the queue
+  size_t stride;        // bytes per slot, header and data
+  size_t size;          // bytes allocated, this struct and the slots
+
+  unsigned int head;    // frames queued, written by the front stage only
+  unsigned int tail;    // frames finished, written by the back stage only
+  bool front_input;     // the front stage needs input before the next frame
+  int bad_last_frame;   // the front stage's error_default() state
+  bool front_done;      // the front stage has finished, with front_result
+  int front_result;
+  int abort;            // MAD_FLOW_STOP or MAD_FLOW_BREAK to wind both stages down
+  bool back_done;       // the back stage has finished
+
+  // right channel of stereo frames finished by STAGE_RIGHT, see mad_decoder_right()
+  bool split;
+  unsigned int right_req;   // frame (tail + 1) handed over, written by the back stage only
+  unsigned int right_done;  // frame finished, written by the right channel stage only
+  bool right_pending;       // the back stage is waiting for right_done
+
+  // the back stage's frame, on the persistent sbsample and overlap
+  struct mad_frame frame;
+  mad_fixed_t (*sbsample)[36][32];
+
+  unsigned char *slots;
+} decoder_pipe_t;
+
 // This is the instance data for a libmad.Decoder object
 typedef struct {
   // every type starts with a base...
   mp_obj_base_t base;
 
-  // add libmad's decoder struct (stream options?)
+  // MAD_OPTION_* for the stream, see Decoder(options=)
   int options;
 
   bool running;
@@ -39,8 +118,51 @@ typedef struct {
   struct mad_frame frame;
   struct mad_synth synth;
 
-  // internal mp3 buffer will be used by the stream object
-  unsigned char mp3buf[MP3_BUF_SIZE];
+  // separately allocated state for the stream/frame/synth, see decoder_state_fit()
+  void *state;
+  unsigned int state_nch;
+  bool state_layer3;
+
+  // caller supplied arenas, if any, and the object(s) they came from to keep them alive
+  decoder_arena_t arena[DECODER_ARENAS_MAX];
+  unsigned int n_arenas;
+  mp_obj_t arena_obj;
+
+  // mp3 input ring used by the stream object, ring_size + MP3_MIRROR_SIZE bytes, see get_input()
+  unsigned char *mp3buf;
+  unsigned int ring_size;     // MP3_BUF_SIZE unless given, a multiple of block_size
+  unsigned int block_size;    // read whole blocks of this many bytes, 1 for any size
+  unsigned int low_water;     // refill between frames below this many unread bytes, 0 for never
+  unsigned int ring_read;     // offset of the unread data
+  unsigned int ring_fill;     // bytes of unread data, possibly wrapping around
+  unsigned int ring_mirrored; // bytes of the start of the ring copied after its end
+  bool ring_eof;              // guard bytes appended after the last of the input
+
+  // buffer being decoded in place instead of calling py_input_cb, see from_buffer()
+  mp_obj_t source;
+  unsigned long source_first; // frames of source before this offset only warm the decoder up
+
+#if defined(MAD_STATS)
+  // time spent in each stage since the last reset, see Decoder.stats()
+  struct mad_stats stats;
+#endif
+
+  // decoding time against playing time since the last reset, see realtime_stop()
+  unsigned int deadline;      // percent of a frame's duration its decoding may take, 0 to not measure
+  mp_obj_t py_ticks_us;       // time.ticks_us
+  mp_uint_t rt_start;         // ticks when the current frame was started
+  unsigned long rt_average;   // moving average of decoding time / duration, see realtime_stop()
+  unsigned long rt_worst_us;  // longest frame
+  unsigned long rt_misses;    // frames over the deadline
+  unsigned long rt_frames;    // frames measured
+
+  // quality level, set by quality() or the governor, see governor()
+  unsigned int quality;
+  unsigned int governor;        // lowest quality level the governor may step down to, 0 for off
+  unsigned int quality_frames;  // frames since the governor last changed the level
+
+  // frame queue between the two stages, see pipeline()
+  decoder_pipe_t *pipe;
 
   // add addional data for MicroPython callbacks
   mp_obj_t cb_data;
@@ -50,11 +172,23 @@ typedef struct {
   mp_obj_t py_output_cb; // enum mad_flow ouptut(data, header, pcm)
   mp_obj_t py_error_cb;  // enum mad_flow error(data, stream, frame)
 
-  mp_obj_t data_left;
-  mp_obj_t data_right;
+  // the frame views returned by get_pcm() and get_frame_header()
+  mp_obj_t pcm_view;
+  mp_obj_t header_view;
   
 } mp_obj_libmad_decoder_t;
 
 int mad_decoder_run(mp_obj_libmad_decoder_t *);
+void mad_decoder_reset(mp_obj_libmad_decoder_t *);
+
+long mad_decoder_pipeline(mp_obj_libmad_decoder_t *, unsigned int depth, bool split);
+void mad_decoder_abort(mp_obj_libmad_decoder_t *);
+void mad_decoder_raised(mp_obj_libmad_decoder_t *, int stage);
+int mad_decoder_front(mp_obj_libmad_decoder_t *);
+int mad_decoder_back(mp_obj_libmad_decoder_t *);
+int mad_decoder_right(mp_obj_libmad_decoder_t *);
+
+void decoder_footprint(decoder_footprint_t *, bool layer3, unsigned int nch, unsigned int ring_size);
+bool decoder_arena_init(mp_obj_libmad_decoder_t *, unsigned char *const base[], size_t const size[], unsigned int count);
 
 #endif
@@ -0,0 +1,477 @@
+/*
+ * bench: host benchmark of libmad, the whole decode and its kernels
+ *
+ *   bench [-n repeat] [-s] [-o out.json] in.mp3
+ *
+ * The file is decoded from memory repeat times (the fastest run counts) for
+ * frames per second, then repeat times more with the per-stage timing of
+ * MAD_STATS for the average ns per frame in each stage. mad_bit_read(), III_huffdecode(),
+ * imdct36(), dct32() and synth_full() are then timed on their own, on data
+ * taken from the file. There is no Python, callback or file I/O in any of
+ * it. -s decodes with MAD_OPTION_SSO.
+ *
+ * The results are written as one JSON object (to stdout unless -o), for
+ * keeping a history of runs and comparing them. layer3.c and synth.c are
+ * compiled into this file rather than linked, to get at their static
+ * kernels.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../libmad/layer3.c"
+#include "../libmad/synth.c"
+
+#if defined(OPT_SSO)
+// only the SSO variant is built
+#define dct32 dct32_sso
+#endif
+
+#ifndef BENCH_FLAGS
+#define BENCH_FLAGS ""
+#endif
+
+// each kernel is run for at least this long
+#define BENCH_MIN_SECONDS 0.2
+
+// caller-owned libmad storage for one decoder
+typedef struct {
+  unsigned char main_data[MAD_BUFFER_MDLEN];
+  mad_fixed_t sbsample[2][36][32];
+  mad_fixed_t overlap[2][32][18];
+  mad_fixed_t filter[2][2][2][16][8];
+  signed short pcm[2][1152];
+} storage_t;
+
+typedef struct {
+  struct mad_stream stream;
+  struct mad_frame frame;
+  struct mad_synth synth;
+  storage_t storage;
+} decoder_t;
+
+// one channel of one granule, positioned at its Huffman data, see capture()
+typedef struct {
+  struct mad_bitptr ptr;
+  struct channel channel;
+  unsigned char const *sfbwidth;
+  unsigned int part2_length;
+} huff_t;
+
+typedef struct {
+  huff_t *huff;
+  unsigned long count;
+  unsigned long alloc;
+  unsigned char **main_data;  // the frames' main data, which the bit pointers point into
+  unsigned long frames;
+} capture_t;
+
+static volatile unsigned long sink;
+
+static unsigned char *read_file(char const *path, unsigned long *len) {
+  FILE *f = fopen(path, "rb");
+  unsigned char *buf = NULL;
+  long size;
+
+  if (f == NULL) {
+    return NULL;
+  }
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+    // zeroed guard bytes after the last frame, as libmad reads a little past it
+    if ((buf = calloc(size + MAD_BUFFER_GUARD, 1)) != NULL && fread(buf, 1, size, f) != (size_t)size) {
+      free(buf);
+      buf = NULL;
+    }
+    *len = size;
+  }
+  fclose(f);
+
+  return buf;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void decoder_start(decoder_t *d, unsigned char *buf, unsigned long len, int options) {
+  mad_stream_init(&d->stream, buf);
+  mad_frame_init(&d->frame);
+  mad_synth_init(&d->synth);
+  mad_stream_attach(&d->stream, d->storage.main_data);
+  mad_frame_attach(&d->frame, 2, d->storage.sbsample, d->storage.overlap);
+  mad_synth_attach(&d->synth, 2, d->storage.filter, d->storage.pcm);
+  d->stream.options = options;
+  mad_stream_buffer(&d->stream, buf, len + MAD_BUFFER_GUARD);
+}
+
+static void decoder_stop(decoder_t *d) {
+  mad_synth_finish(&d->synth);
+  mad_frame_finish(&d->frame);
+  mad_stream_finish(&d->stream);
+}
+
+/*
+ * The Huffman data of a Layer III frame, before mad_layer_III() reads it:
+ * like mad_layer_III() and III_spectrum(), but into a copy of the main
+ * data, and keeping the bit position of each granule and channel.
+ */
+static void capture(capture_t *cap, struct mad_stream const *stream, struct mad_header const *header) {
+  struct mad_bitptr ptr = stream->ptr;
+  struct sideinfo si;
+  unsigned int nch = MAD_NCHANNELS(header), ngr, lsf, data_bitlen, priv_bitlen, sfreqi;
+  unsigned long rest, size;
+  unsigned char *md;
+  mad_fixed_t xr[576];
+
+  lsf = (header->flags & MAD_FLAG_LSF_EXT) != 0;
+  ngr = lsf ? 1 : 2;
+  if (III_sideinfo(&ptr, nch, lsf, &si, &data_bitlen, &priv_bitlen) != MAD_ERROR_NONE ||
+      si.main_data_begin > stream->md_len) {
+    return;
+  }
+
+  // the end of the bit reservoir followed by the rest of this frame
+  rest = stream->next_frame - mad_bit_nextbyte(&ptr);
+  size = si.main_data_begin + rest;
+  if ((md = calloc(size + MAD_BUFFER_GUARD, 1)) == NULL) {
+    return;
+  }
+  memcpy(md, stream->main_data + stream->md_len - si.main_data_begin, si.main_data_begin);
+  memcpy(md + si.main_data_begin, mad_bit_nextbyte(&ptr), rest);
+  cap->main_data = realloc(cap->main_data, (cap->frames + 1) * sizeof(*cap->main_data));
+  cap->main_data[cap->frames++] = md;
+
+  if (cap->count + ngr * nch > cap->alloc) {
+    cap->alloc = cap->alloc ? cap->alloc * 2 : 1024;
+    cap->huff = realloc(cap->huff, cap->alloc * sizeof(*cap->huff));
+  }
+
+  sfreqi = III_sfreqi(header);
+  mad_bit_init(&ptr, md);
+  for (unsigned int gr = 0; gr < ngr; gr++) {
+    for (unsigned int ch = 0; ch < nch; ch++) {
+      struct channel *channel = &si.gr[gr].ch[ch];
+      huff_t *huff = &cap->huff[cap->count++];
+
+      if (lsf) {
+        huff->part2_length = III_scalefactors_lsf(&ptr, channel, ch == 0 ? 0 : &si.gr[1].ch[1], header->mode_extension);
+      } else {
+        huff->part2_length = III_scalefactors(&ptr, channel, &si.gr[0].ch[ch], gr == 0 ? 0 : si.scfsi[ch]);
+      }
+      huff->ptr = ptr;
+      huff->channel = *channel;
+      huff->sfbwidth = III_sfbwidth(sfreqi, channel);
+
+      // leaves ptr at the next channel's scalefactors
+      III_huffdecode(&ptr, xr, channel, huff->sfbwidth, huff->part2_length);
+    }
+  }
+}
+
+/*
+ * Decode the whole file, timing the stages in stats unless that's NULL,
+ * and capturing the Huffman data into cap unless that's NULL. Returns the
+ * frames decoded, with the playing time in *duration.
+ */
+static unsigned long decode(decoder_t *d, unsigned char *buf, unsigned long len, int options,
+                            struct mad_stats *stats, capture_t *cap, mad_timer_t *duration) {
+  unsigned long frames = 0;
+
+  decoder_start(d, buf, len, options);
+  d->frame.stats = stats;
+  *duration = mad_timer_zero;
+
+  while (1) {
+    int result;
+    {
+      MAD_STATS_START(t);
+      result = mad_header_decode(&d->frame.header, &d->stream);
+      MAD_STATS_STOP(stats, MAD_STAGE_HEADER, t);
+    }
+    if (result == -1) {
+      if (!MAD_RECOVERABLE(d->stream.error)) {
+        break;
+      }
+      continue;
+    }
+    if (cap && d->frame.header.layer == MAD_LAYER_III) {
+      capture(cap, &d->stream, &d->frame.header);
+    }
+    if (mad_frame_decode(&d->frame, &d->stream) == -1) {
+      if (!MAD_RECOVERABLE(d->stream.error)) {
+        break;
+      }
+      continue;
+    }
+    {
+      MAD_STATS_START(t);
+      mad_synth_frame(&d->synth, &d->frame);
+      MAD_STATS_STOP(stats, MAD_STAGE_SYNTH, t);
+    }
+    mad_timer_add(duration, d->frame.header.duration);
+    frames++;
+  }
+
+  decoder_stop(d);
+
+  return frames;
+}
+
+/*
+ * Call fn(arg) until BENCH_MIN_SECONDS have passed, doubling the calls
+ * between clock reads; fn does ops operations a call. Returns ns per
+ * operation.
+ */
+static double measure(void (*fn)(void *), void *arg, unsigned long ops) {
+  unsigned long calls = 0, batch = 1;
+  double t0, t;
+
+  fn(arg);  // warm the caches up
+  t0 = now();
+  do {
+    for (unsigned long i = 0; i < batch; i++) {
+      fn(arg);
+    }
+    calls += batch;
+    batch *= 2;
+    t = now() - t0;
+  } while (t < BENCH_MIN_SECONDS);
+
+  return t * 1e9 / ((double)calls * ops);
+}
+
+#define BIT_READS 4096
+
+typedef struct {
+  unsigned char data[BIT_READS * 2 + MAD_BUFFER_GUARD];  // 16 bits a read at most
+  unsigned char len[BIT_READS];
+} bit_bench_t;
+
+static void bench_bit_read(void *arg) {
+  bit_bench_t *b = arg;
+  struct mad_bitptr ptr;
+  unsigned long sum = 0;
+
+  mad_bit_init(&ptr, b->data);
+  for (unsigned int i = 0; i < BIT_READS; i++) {
+    sum += mad_bit_read(&ptr, b->len[i]);
+  }
+  sink += sum;
+}
+
+static void bench_huffdecode(void *arg) {
+  capture_t *cap = arg;
+  mad_fixed_t xr[576];
+
+  for (unsigned long i = 0; i < cap->count; i++) {
+    huff_t *huff = &cap->huff[i];
+    struct mad_bitptr ptr = huff->ptr;
+
+    III_huffdecode(&ptr, xr, &huff->channel, huff->sfbwidth, huff->part2_length);
+  }
+  sink += xr[0];
+}
+
+#define KERNEL_INPUTS 64
+
+typedef struct {
+  mad_fixed_t in[KERNEL_INPUTS][32];
+  mad_fixed_t out[36];
+  mad_fixed_t lo[16][8], hi[16][8];
+} kernel_bench_t;
+
+static void bench_imdct36(void *arg) {
+  kernel_bench_t *k = arg;
+
+  for (unsigned int i = 0; i < KERNEL_INPUTS; i++) {
+    imdct36(k->in[i], k->out);
+  }
+  sink += k->out[0];
+}
+
+static void bench_dct32(void *arg) {
+  kernel_bench_t *k = arg;
+
+  for (unsigned int i = 0; i < KERNEL_INPUTS; i++) {
+    dct32(k->in[i], i & 7, k->lo, k->hi);
+  }
+  sink += k->lo[0][0];
+}
+
+// synth_full(), or its SSO variant with -s
+static void bench_synth_full(void *arg) {
+  decoder_t *d = arg;
+
+  synth_func(d->frame.options)(&d->synth, &d->frame, MAD_NCHANNELS(&d->frame.header), MAD_NSBSAMPLES(&d->frame.header));
+  sink += d->synth.pcm.samples[0][0];
+}
+
+// ns per tick of mad_ticks(), 0 when the target has no counter
+static double tick_ns(void) {
+  double t0 = now(), t;
+  uint32_t k0 = mad_ticks(), k;
+
+  do {
+    t = now() - t0;
+    k = mad_ticks_since(k0);
+  } while (t < 0.02);
+
+  return k ? t * 1e9 / k : 0;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: bench [-n repeat] [-s] [-o out.json] in.mp3\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  static char const *const stage_name[MAD_STAGE_COUNT] = {
+    "header", "sideinfo", "huffman", "stereo", "imdct", "synth", "input", "output"
+  };
+  static decoder_t d;
+  static bit_bench_t bits;
+  static kernel_bench_t kernel;
+  long repeat = 5;
+  int options = 0, opt;
+  char const *path = NULL;
+  unsigned char *buf;
+  unsigned long len, frames = 0;
+  struct mad_stats stats;
+  capture_t cap = { 0 };
+  mad_timer_t duration;
+  double best = 0, ns;
+  FILE *out = stdout;
+
+  while ((opt = getopt(argc, argv, "n:so:")) != -1) {
+    switch (opt) {
+      case 'n':
+        repeat = atol(optarg);
+        break;
+      case 's':
+        options |= MAD_OPTION_SSO;
+        break;
+      case 'o':
+        path = optarg;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (argc - optind != 1 || repeat < 1) {
+    usage();
+  }
+
+  if ((buf = read_file(argv[optind], &len)) == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  mad_ticks_init();
+
+  // the whole decode, the fastest of repeat runs
+  for (long i = 0; i < repeat; i++) {
+    double t0 = now(), t;
+    frames = decode(&d, buf, len, options, NULL, NULL, &duration);
+    t = now() - t0;
+    if (i == 0 || t < best) {
+      best = t;
+    }
+  }
+  if (frames == 0) {
+    fprintf(stderr, "bench: no frames in %s\n", argv[optind]);
+    return 1;
+  }
+
+  // as many more, timing the stages, and capturing the Huffman data once
+  memset(&stats, 0, sizeof(stats));
+  for (long i = 0; i < repeat; i++) {
+    decode(&d, buf, len, options, &stats, i == 0 ? &cap : NULL, &duration);
+  }
+  ns = tick_ns();
+
+  // kernel inputs: random bit widths and well scaled random samples
+  srand(1);
+  for (unsigned int i = 0; i < sizeof(bits.data); i++) {
+    bits.data[i] = rand();
+  }
+  for (unsigned int i = 0; i < BIT_READS; i++) {
+    bits.len[i] = 1 + rand() % 16;
+  }
+  for (unsigned int i = 0; i < KERNEL_INPUTS; i++) {
+    for (unsigned int j = 0; j < 32; j++) {
+      kernel.in[i][j] = (rand() % MAD_F_ONE) - MAD_F_ONE / 2;
+    }
+  }
+
+  if (path && (out = fopen(path, "w")) == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"file\": \"%s\",\n", argv[optind]);
+  fprintf(out, "  \"flags\": \"%s\",\n", BENCH_FLAGS);
+  fprintf(out, "  \"options\": %d,\n", options);
+  fprintf(out, "  \"frames\": %lu,\n", frames);
+  fprintf(out, "  \"decode\": {\n");
+  fprintf(out, "    \"seconds\": %.6f,\n", best);
+  fprintf(out, "    \"frames_per_second\": %.1f,\n", frames / best);
+  fprintf(out, "    \"ns_per_frame\": %.1f,\n", best * 1e9 / frames);
+  fprintf(out, "    \"realtime\": %.1f\n", mad_timer_count(duration, MAD_UNITS_MILLISECONDS) / (best * 1e3));
+  fprintf(out, "  },\n");
+
+  // per stage, from the ticks MAD_STATS counted, converted to ns; clock is the counter they came from
+  fprintf(out, "  \"stages\": {\n");
+  fprintf(out, "    \"clock\": \"%s\",\n", MAD_TICKS_UNIT);
+  fprintf(out, "    \"ns_per_frame\": {");
+  for (int i = 0; i < MAD_STAGE_COUNT; i++) {
+    if (i == MAD_STAGE_INPUT || i == MAD_STAGE_OUTPUT) {
+      continue;  // there is no input or output here
+    }
+    fprintf(out, "%s\n      \"%s\": ", i ? "," : "", stage_name[i]);
+    if (ns) {
+      fprintf(out, "%.1f", stats.total[i] * ns / (frames * repeat));
+    } else {
+      fprintf(out, "null");
+    }
+  }
+  fprintf(out, "\n    }\n  },\n");
+
+  // each kernel on its own
+  fprintf(out, "  \"kernels_ns_per_call\": {\n");
+  fprintf(out, "    \"mad_bit_read\": %.2f,\n", measure(bench_bit_read, &bits, BIT_READS));
+  if (cap.count) {
+    fprintf(out, "    \"III_huffdecode\": %.1f,\n", measure(bench_huffdecode, &cap, cap.count));
+  } else {
+    fprintf(out, "    \"III_huffdecode\": null,\n");  // not Layer III
+  }
+  fprintf(out, "    \"imdct36\": %.1f,\n", measure(bench_imdct36, &kernel, KERNEL_INPUTS));
+  fprintf(out, "    \"dct32\": %.1f,\n", measure(bench_dct32, &kernel, KERNEL_INPUTS));
+
+  // on the first frame's subband samples
+  decoder_start(&d, buf, len, options);
+  while (mad_frame_decode(&d.frame, &d.stream) == -1 && MAD_RECOVERABLE(d.stream.error)) {
+  }
+  fprintf(out, "    \"synth_full\": %.1f\n", measure(bench_synth_full, &d, 1));
+  decoder_stop(&d);
+  fprintf(out, "  }\n");
+  fprintf(out, "}\n");
+
+  if (out != stdout && fclose(out) != 0) {
+    perror(path);
+    return 1;
+  }
+
+  for (unsigned long i = 0; i < cap.frames; i++) {
+    free(cap.main_data[i]);
+  }
+  free(cap.main_data);
+  free(cap.huff);
+  free(buf);
+
+  return 0;
+}
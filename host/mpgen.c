@@ -0,0 +1,1115 @@
+/*
+ * mpgen: synthetic MPEG audio streams for the decoder paths test.mp3 misses
+ *
+ *   mpgen [-n frames] [-l] dir [name...]
+ *
+ * test/test.mp3 is a single MPEG-1 Layer III joint stereo stream, so on its
+ * own it leaves Layer I and II, the MPEG-2 and MPEG-2.5 sampling
+ * frequencies, intensity stereo, short and mixed blocks, free format and CRC
+ * protected frames untested. This writes each of the streams in streams[]
+ * below, or only the ones named, to dir/<name>.mp3; -l lists them with what
+ * they cover. The GEN_LOUD ones are left out unless they're named.
+ *
+ * The content is pseudo-random, seeded from the stream's name, so the files
+ * are the same on every host and in every run, but every frame is valid: the
+ * bit allocations, scalefactors, side info, Huffman codes and the bit
+ * reservoir all follow the standard, and the streams decode without a
+ * single error. The tables are libmad's own: layer12.c and layer3.c are
+ * compiled into this file for their statics, and the Huffman codes are read
+ * back out of the decoder's tables in huffman.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../libmad/layer12.c"
+#include "../libmad/layer3.c"
+
+// what a stream exercises, beyond its layer, version and mode
+#define GEN_CRC    0x01  // CRC protected frames
+#define GEN_FREE   0x02  // free format, bitrate index 0
+#define GEN_MS     0x04  // Layer III joint stereo: middle/side frames
+#define GEN_IS     0x08  // Layer III joint stereo: intensity frames
+#define GEN_SHORT  0x10  // Layer III: start, short and stop blocks
+#define GEN_MIXED  0x20  // Layer III: some of the short blocks mixed
+#define GEN_LOUD   0x40  // Layer III: linbits values at gains that saturate, only when named
+
+#define GEN_MPEG1  0
+#define GEN_MPEG2  1
+#define GEN_MPEG25 2
+
+// header mode field
+#define GEN_STEREO 0
+#define GEN_JOINT  1
+#define GEN_DUAL   2
+#define GEN_MONO   3
+
+typedef struct {
+  char const *name;
+  unsigned int layer;
+  unsigned int version;
+  unsigned int samplerate;
+  unsigned int mode;
+  unsigned int kbps;
+  unsigned int flags;
+  char const *covers;
+} stream_t;
+
+static stream_t const streams[] = {
+  { "l1-stereo",     1, GEN_MPEG1,  48000, GEN_STEREO, 384, 0,
+    "Layer I" },
+  { "l1-joint-crc",  1, GEN_MPEG1,  44100, GEN_JOINT,  320, GEN_CRC,
+    "Layer I intensity bound, CRC, padding" },
+  { "l1-mono",       1, GEN_MPEG1,  32000, GEN_MONO,   192, 0,
+    "Layer I single channel" },
+  { "l1-lsf-dual",   1, GEN_MPEG2,  24000, GEN_DUAL,   128, 0,
+    "Layer I MPEG-2, dual channel" },
+  { "l2-stereo-crc", 2, GEN_MPEG1,  48000, GEN_STEREO, 256, GEN_CRC,
+    "Layer II table B.2a, CRC" },
+  { "l2-joint",      2, GEN_MPEG1,  44100, GEN_JOINT,  192, 0,
+    "Layer II table B.2b, intensity bound, padding" },
+  { "l2-mono-low",   2, GEN_MPEG1,  44100, GEN_MONO,    48, 0,
+    "Layer II table B.2c, grouped samples" },
+  { "l2-dual-32k",   2, GEN_MPEG1,  32000, GEN_DUAL,    64, 0,
+    "Layer II table B.2d, dual channel" },
+  { "l2-lsf",        2, GEN_MPEG2,  22050, GEN_JOINT,   96, 0,
+    "Layer II MPEG-2 table B.1, intensity bound" },
+  { "l2-free",       2, GEN_MPEG1,  48000, GEN_STEREO, 200, GEN_FREE | GEN_CRC,
+    "Layer II free format, CRC" },
+  { "l3-stereo-crc", 3, GEN_MPEG1,  44100, GEN_STEREO, 192, GEN_CRC | GEN_SHORT,
+    "Layer III block switching, scfsi, CRC, padding" },
+  { "l3-joint",      3, GEN_MPEG1,  48000, GEN_JOINT,  256, GEN_MS | GEN_IS | GEN_SHORT | GEN_MIXED,
+    "Layer III middle/side and intensity stereo, mixed blocks" },
+  { "l3-mono-mixed", 3, GEN_MPEG1,  32000, GEN_MONO,    96, GEN_SHORT | GEN_MIXED,
+    "Layer III single channel, mixed blocks" },
+  { "l3-lsf",        3, GEN_MPEG2,  22050, GEN_JOINT,   64, GEN_MS | GEN_IS | GEN_SHORT,
+    "Layer III MPEG-2, LSF scalefactors and intensity stereo" },
+  { "l3-lsf-mono",   3, GEN_MPEG2,  24000, GEN_MONO,    32, GEN_CRC | GEN_SHORT | GEN_MIXED,
+    "Layer III MPEG-2 single channel, mixed blocks, CRC" },
+  { "l3-mpeg25",     3, GEN_MPEG25,  8000, GEN_JOINT,   24, GEN_MS | GEN_IS | GEN_SHORT | GEN_MIXED,
+    "Layer III MPEG-2.5 8 kHz, its own mixed block bands" },
+  { "l3-mpeg25-11k", 3, GEN_MPEG25, 11025, GEN_STEREO,  32, GEN_CRC | GEN_SHORT,
+    "Layer III MPEG-2.5 11.025 kHz, CRC" },
+  { "l3-free",       3, GEN_MPEG1,  44100, GEN_JOINT,  400, GEN_FREE | GEN_MS | GEN_SHORT,
+    "Layer III free format" },
+  { "l3-loud",       3, GEN_MPEG1,  44100, GEN_STEREO, 320, GEN_LOUD,
+    "Layer III large values and gains, requantization overflow" },
+};
+
+#define NSTREAMS (sizeof(streams) / sizeof(streams[0]))
+
+// frame.c's bitrate_table, in kbps
+static unsigned short const kbps_table[5][15] = {
+  { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+  { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+  { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 },
+  { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256 },
+  { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 }
+};
+
+static unsigned int const rate_table[3] = { 44100, 48000, 32000 };
+
+// --- Output -----------------------------------------------------------------
+
+typedef struct {
+  unsigned char *data;
+  unsigned long size;   // bytes allocated
+  unsigned long bits;   // bits written
+} bits_t;
+
+static void reserve(bits_t *b, unsigned long bytes) {
+  while (b->size < bytes) {
+    b->size = b->size ? 2 * b->size : 1024;
+    b->data = realloc(b->data, b->size);
+    if (b->data == NULL) {
+      perror("mpgen");
+      exit(1);
+    }
+  }
+}
+
+static void put(bits_t *b, unsigned long value, unsigned int n) {
+  while (n--) {
+    unsigned long byte = b->bits >> 3;
+
+    reserve(b, byte + 1);
+    if ((b->bits & 7) == 0) {
+      b->data[byte] = 0;
+    }
+    if ((value >> n) & 1) {
+      b->data[byte] |= 0x80 >> (b->bits & 7);
+    }
+    b->bits++;
+  }
+}
+
+// zero bits up to the next byte, or to the given length in bytes
+static void put_zeros(bits_t *b, unsigned long bytes) {
+  while (b->bits & 7) {
+    put(b, 0, 1);
+  }
+  while (b->bits < bytes * 8) {
+    put(b, 0, 8);
+  }
+}
+
+static unsigned long long seed;
+
+// pseudo-random integer in 0..n-1
+static unsigned int rnd(unsigned int n) {
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return n ? (unsigned int)(seed >> 33) % n : 0;
+}
+
+// --- Frames -----------------------------------------------------------------
+
+// the state of one stream while it's written
+typedef struct {
+  stream_t const *s;
+  unsigned int nch;
+  unsigned int bitrate_index;
+  unsigned long frame;      // frames written
+  unsigned int mode_ext;    // of the frame being written
+  unsigned int last_block[2];
+  bits_t out;
+} gen_t;
+
+// length in bytes of frame i, and whether it's padded
+static unsigned int frame_bytes(gen_t const *g, unsigned long i, unsigned int *pad) {
+  stream_t const *s = g->s;
+  unsigned long long br = s->kbps * 1000ULL, per, rest;
+
+  per = s->layer == 1 ? 12 : (s->layer == 3 && s->version != GEN_MPEG1) ? 72 : 144;
+  rest = per * br % s->samplerate;
+
+  // pad just often enough to keep to the bitrate, as encoders do
+  *pad = (s->flags & GEN_FREE) ? 0 : (unsigned int)((i + 1) * rest / s->samplerate - i * rest / s->samplerate);
+
+  return (unsigned int)(per * br / s->samplerate + *pad) * (s->layer == 1 ? 4 : 1);
+}
+
+static void put_header(gen_t *g, bits_t *f, unsigned int pad) {
+  stream_t const *s = g->s;
+  unsigned int sri;
+
+  for (sri = 0; rate_table[sri] >> s->version != s->samplerate; ++sri) {
+  }
+
+  put(f, 0x7ff, 11);
+  put(f, s->version != GEN_MPEG25, 1);
+  put(f, s->version == GEN_MPEG1, 1);
+  put(f, 4 - s->layer, 2);
+  put(f, !(s->flags & GEN_CRC), 1);
+  put(f, g->bitrate_index, 4);
+  put(f, sri, 2);
+  put(f, pad, 1);
+  put(f, rnd(2), 1);               // private_bit
+  put(f, s->mode, 2);
+  put(f, g->mode_ext, 2);
+  put(f, rnd(2), 1);               // copyright
+  put(f, rnd(2), 1);               // original
+  put(f, "\0\1\3"[rnd(3)], 2);     // emphasis, never the reserved 2
+  if (s->flags & GEN_CRC) {
+    put(f, 0, 16);                 // see put_crc()
+  }
+}
+
+// the CRC over the header and the crc_bits after it, as frame.c and the layers check it
+static void put_crc(gen_t *g, bits_t *f, unsigned int crc_bits) {
+  struct mad_bitptr ptr;
+  unsigned short crc;
+
+  if (!(g->s->flags & GEN_CRC)) {
+    return;
+  }
+  mad_bit_init(&ptr, f->data + 2);
+  crc = mad_bit_crc(ptr, 16, 0xffff);
+  mad_bit_init(&ptr, f->data + 6);
+  crc = mad_bit_crc(ptr, crc_bits, crc);
+  f->data[4] = crc >> 8;
+  f->data[5] = crc & 0xff;
+}
+
+static void put_frame(gen_t *g, bits_t *f, unsigned int bytes) {
+  put_zeros(f, bytes);
+  reserve(&g->out, g->out.bits / 8 + bytes);
+  memcpy(g->out.data + g->out.bits / 8, f->data, bytes);
+  g->out.bits += bytes * 8;
+  g->frame++;
+}
+
+// --- Layer I ----------------------------------------------------------------
+
+static void layer_I(gen_t *g, bits_t *f) {
+  unsigned int pad, bytes = frame_bytes(g, g->frame, &pad);
+  unsigned int nch = g->nch, bound = 32, top, budget, used, sb, ch, s;
+  unsigned char allocation[2][32], scalefactor[2][32];
+
+  if (g->s->mode == GEN_JOINT) {
+    g->mode_ext = rnd(4);
+    bound = 4 + g->mode_ext * 4;
+  }
+
+  // allocate bits from the lowest subband up, while there's room in the frame
+  budget = (bytes - 4 - ((g->s->flags & GEN_CRC) ? 2 : 0)) * 8;
+  used = 4 * (bound * nch + 32 - bound);
+  top = 16 + rnd(17);
+  memset(allocation, 0, sizeof(allocation));
+  for (sb = 0; sb < top; ++sb) {
+    for (ch = 0; ch < (sb < bound ? nch : 1); ++ch) {
+      unsigned int nb = rnd(4) ? 2 + rnd(14) : 0;
+
+      while (nb && used + 6 * (sb < bound ? 1 : nch) + 12 * nb > budget) {
+        nb = nb > 2 ? nb - 1 : 0;
+      }
+      if (nb) {
+        used += 6 * (sb < bound ? 1 : nch) + 12 * nb;
+      }
+      allocation[ch][sb] = nb;
+      if (sb >= bound) {
+        allocation[1][sb] = nb;
+      }
+    }
+  }
+
+  f->bits = 0;
+  put_header(g, f, pad);
+
+  for (sb = 0; sb < 32; ++sb) {
+    for (ch = 0; ch < (sb < bound ? nch : 1); ++ch) {
+      put(f, allocation[ch][sb] ? allocation[ch][sb] - 1 : 0, 4);
+    }
+  }
+  for (sb = 0; sb < 32; ++sb) {
+    for (ch = 0; ch < nch; ++ch) {
+      if (allocation[ch][sb]) {
+        scalefactor[ch][sb] = 12 + rnd(40);
+        put(f, scalefactor[ch][sb], 6);
+      }
+    }
+  }
+  for (s = 0; s < 12; ++s) {
+    for (sb = 0; sb < 32; ++sb) {
+      for (ch = 0; ch < (sb < bound ? nch : 1); ++ch) {
+        unsigned int nb = allocation[ch][sb];
+
+        if (nb) {
+          put(f, rnd((1 << nb) - 1), nb);  // all ones is not a valid sample
+        }
+      }
+    }
+  }
+
+  put_zeros(f, bytes);
+  put_crc(g, f, 4 * (bound * nch + 32 - bound));
+  put_frame(g, f, bytes);
+}
+
+// --- Layer II ---------------------------------------------------------------
+
+// the table of quantization per subband, chosen as layer12.c chooses it
+static unsigned int layer_II_table(gen_t const *g) {
+  unsigned int kbps = g->s->kbps / g->nch;
+
+  if (g->s->version != GEN_MPEG1) {
+    return 4;
+  }
+  if (!(g->s->flags & GEN_FREE)) {
+    if (kbps <= 48) {
+      return g->s->samplerate == 32000 ? 3 : 2;
+    }
+    if (kbps <= 80) {
+      return 0;
+    }
+  }
+  return g->s->samplerate == 48000 ? 0 : 1;
+}
+
+static void layer_II(gen_t *g, bits_t *f) {
+  static unsigned int const nscf[4] = { 3, 2, 1, 2 };
+  unsigned int pad, bytes = frame_bytes(g, g->frame, &pad);
+  unsigned int nch = g->nch, index, sblimit, bound, budget, used, crc_bits, sb, ch, gr, s;
+  unsigned char const *offsets;
+  unsigned char allocation[2][32], scfsi[2][32];
+
+  index = layer_II_table(g);
+  sblimit = sbquant_table[index].sblimit;
+  offsets = sbquant_table[index].offsets;
+
+  bound = 32;
+  if (g->s->mode == GEN_JOINT) {
+    g->mode_ext = rnd(4);
+    bound = 4 + g->mode_ext * 4;
+  }
+  if (bound > sblimit) {
+    bound = sblimit;
+  }
+
+  budget = (bytes - 4 - ((g->s->flags & GEN_CRC) ? 2 : 0)) * 8;
+  used = 0;
+  for (sb = 0; sb < sblimit; ++sb) {
+    used += bitalloc_table[offsets[sb]].nbal * (sb < bound ? nch : 1);
+  }
+
+  memset(allocation, 0, sizeof(allocation));
+  for (sb = 0; sb < sblimit; ++sb) {
+    unsigned int nbal = bitalloc_table[offsets[sb]].nbal;
+
+    for (ch = 0; ch < (sb < bound ? nch : 1); ++ch) {
+      unsigned int a = rnd(4) ? 1 + rnd((1 << nbal) - 1) : 0;
+
+      while (a) {
+        struct quantclass const *qc = &qc_table[offset_table[bitalloc_table[offsets[sb]].offset][a - 1]];
+        unsigned int share = sb < bound ? 1 : nch, cost;
+
+        // scfsi and up to three scalefactors for each channel, twelve granules of samples
+        cost = (2 + 6 * 3) * share + 12 * (qc->group ? qc->bits : 3 * qc->bits);
+        if (used + cost <= budget) {
+          used += cost;
+          break;
+        }
+        a--;
+      }
+      allocation[ch][sb] = a;
+      if (sb >= bound) {
+        allocation[1][sb] = a;
+      }
+    }
+  }
+
+  f->bits = 0;
+  put_header(g, f, pad);
+  crc_bits = f->bits;
+
+  for (sb = 0; sb < sblimit; ++sb) {
+    for (ch = 0; ch < (sb < bound ? nch : 1); ++ch) {
+      put(f, allocation[ch][sb], bitalloc_table[offsets[sb]].nbal);
+    }
+  }
+  for (sb = 0; sb < sblimit; ++sb) {
+    for (ch = 0; ch < nch; ++ch) {
+      if (allocation[ch][sb]) {
+        scfsi[ch][sb] = rnd(4);
+        put(f, scfsi[ch][sb], 2);
+      }
+    }
+  }
+  crc_bits = f->bits - crc_bits;
+
+  for (sb = 0; sb < sblimit; ++sb) {
+    for (ch = 0; ch < nch; ++ch) {
+      if (allocation[ch][sb]) {
+        for (s = 0; s < nscf[scfsi[ch][sb]]; ++s) {
+          put(f, 12 + rnd(40), 6);
+        }
+      }
+    }
+  }
+  for (gr = 0; gr < 12; ++gr) {
+    for (sb = 0; sb < sblimit; ++sb) {
+      for (ch = 0; ch < (sb < bound ? nch : 1); ++ch) {
+        unsigned int a = allocation[ch][sb];
+        struct quantclass const *qc;
+
+        if (!a) {
+          continue;
+        }
+        qc = &qc_table[offset_table[bitalloc_table[offsets[sb]].offset][a - 1]];
+        if (qc->group) {
+          unsigned int n = qc->nlevels;
+
+          put(f, rnd(n) + n * rnd(n) + n * n * rnd(n), qc->bits);
+        }
+        else {
+          for (s = 0; s < 3; ++s) {
+            put(f, rnd(qc->nlevels), qc->bits);
+          }
+        }
+      }
+    }
+  }
+
+  put_zeros(f, bytes);
+  put_crc(g, f, crc_bits);
+  put_frame(g, f, bytes);
+}
+
+// --- Layer III --------------------------------------------------------------
+
+// Huffman codes, from walking the decoder's tables
+typedef struct {
+  unsigned long code;
+  unsigned char len;
+  unsigned char set;
+} hcode_t;
+
+static hcode_t pair_code[32][16][16];
+static unsigned int pair_max[32];     // largest value a table codes without linbits
+static hcode_t quad_code[2][16];
+
+static void walk_pair(unsigned int t, union huffpair const *table, unsigned int offset,
+                      unsigned int bits, unsigned long prefix, unsigned int len) {
+  unsigned int i;
+
+  for (i = 0; i < 1U << bits; ++i) {
+    union huffpair const *pair = &table[offset + i];
+
+    if (pair->final) {
+      hcode_t *c = &pair_code[t][pair->value.x][pair->value.y];
+      unsigned int hlen = pair->value.hlen;
+
+      if (!c->set) {
+        c->code = (prefix << hlen) | (i >> (bits - hlen));
+        c->len = len + hlen;
+        c->set = 1;
+      }
+      if (pair->value.x > pair_max[t]) {
+        pair_max[t] = pair->value.x;
+      }
+    }
+    else {
+      walk_pair(t, table, pair->ptr.offset, pair->ptr.bits, (prefix << bits) | i, len + bits);
+    }
+  }
+}
+
+static void walk_quad(unsigned int t, union huffquad const *table, unsigned int offset,
+                      unsigned int bits, unsigned long prefix, unsigned int len) {
+  unsigned int i;
+
+  for (i = 0; i < 1U << bits; ++i) {
+    union huffquad const *quad = &table[offset + i];
+
+    if (quad->final) {
+      hcode_t *c = &quad_code[t][quad->value.v << 3 | quad->value.w << 2 | quad->value.x << 1 | quad->value.y];
+      unsigned int hlen = quad->value.hlen;
+
+      if (!c->set) {
+        c->code = (prefix << hlen) | (i >> (bits - hlen));
+        c->len = len + hlen;
+        c->set = 1;
+      }
+    }
+    else {
+      walk_quad(t, table, quad->ptr.offset, quad->ptr.bits, (prefix << bits) | i, len + bits);
+    }
+  }
+}
+
+static void huffman_init(void) {
+  unsigned int t;
+
+  for (t = 0; t < 32; ++t) {
+    if (mad_huff_pair_table[t].table) {
+      walk_pair(t, mad_huff_pair_table[t].table, 0, mad_huff_pair_table[t].startbits, 0, 0);
+    }
+  }
+  for (t = 0; t < 2; ++t) {
+    walk_quad(t, mad_huff_quad_table[t], 0, 4, 0, 0);
+  }
+}
+
+// a random table that codes values up to max
+static unsigned int huffman_table(unsigned int max) {
+  unsigned int candidates[32], n = 0, t;
+
+  for (t = 0; t < 32; ++t) {
+    struct hufftable const *entry = &mad_huff_pair_table[t];
+
+    if (entry->table == 0) {
+      continue;
+    }
+    if (entry->linbits ? max <= 15 + (1U << entry->linbits) - 1 : max <= pair_max[t]) {
+      candidates[n++] = t;
+    }
+  }
+  return candidates[rnd(n)];
+}
+
+static void put_pair(bits_t *b, unsigned int t, int x, int y) {
+  unsigned int linbits = mad_huff_pair_table[t].linbits;
+  unsigned int ax = abs(x), ay = abs(y);
+  unsigned int cx = linbits && ax > 15 ? 15 : ax, cy = linbits && ay > 15 ? 15 : ay;
+
+  put(b, pair_code[t][cx][cy].code, pair_code[t][cx][cy].len);
+  if (linbits && cx == 15) {
+    put(b, ax - 15, linbits);
+  }
+  if (ax) {
+    put(b, x < 0, 1);
+  }
+  if (linbits && cy == 15) {
+    put(b, ay - 15, linbits);
+  }
+  if (ay) {
+    put(b, y < 0, 1);
+  }
+}
+
+static void put_quad(bits_t *b, unsigned int t, int const v[4]) {
+  unsigned int i, index = 0;
+
+  for (i = 0; i < 4; ++i) {
+    index = index << 1 | (v[i] != 0);
+  }
+  put(b, quad_code[t][index].code, quad_code[t][index].len);
+  for (i = 0; i < 4; ++i) {
+    if (v[i]) {
+      put(b, v[i] < 0, 1);
+    }
+  }
+}
+
+// one granule of one channel: its side info, in struct channel, and quantized lines
+typedef struct {
+  struct channel c;
+  int is[576];
+  unsigned int count1;    // end of the count1 region, in lines
+} gch_t;
+
+// the main data of one frame, ahead of the frame itself, see layer_III()
+typedef struct {
+  gch_t gch[2][2];
+  unsigned int scfsi[2];
+  unsigned int mode_ext;
+  bits_t data;
+} md_t;
+
+static unsigned int sfreqi(stream_t const *s) {
+  static unsigned int const rates[9] = { 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000 };
+  unsigned int i;
+
+  for (i = 0; rates[i] != s->samplerate; ++i) {
+  }
+  return i;
+}
+
+// the block types of one granule, switching the way encoders do: a start
+// block before short blocks, a stop block after them
+static void III_blocks(gen_t *g, md_t *md, unsigned int gr) {
+  unsigned int ch;
+
+  for (ch = 0; ch < g->nch; ++ch) {
+    struct channel *c = &md->gch[gr][ch].c;
+    unsigned int last = g->last_block[ch];
+
+    if (ch == 1 && g->s->mode == GEN_JOINT) {
+      // III_stereo() needs the channels to agree
+      c->block_type = md->gch[gr][0].c.block_type;
+      c->flags = md->gch[gr][0].c.flags & mixed_block_flag;
+    }
+    else {
+      if (!(g->s->flags & GEN_SHORT)) {
+        c->block_type = 0;
+      }
+      else if (last == 1) {
+        c->block_type = 2;
+      }
+      else if (last == 2) {
+        c->block_type = rnd(2) ? 2 : 3;
+      }
+      else {
+        c->block_type = rnd(3) ? 0 : 1;
+      }
+      c->flags = c->block_type == 2 && (g->s->flags & GEN_MIXED) && rnd(2) ? mixed_block_flag : 0;
+    }
+    g->last_block[ch] = c->block_type;
+  }
+}
+
+// scalefactor bit lengths and counts of an LSF channel, as III_scalefactors_lsf() reads them
+static void III_lsf_slen(struct channel *c, int is_right, unsigned int slen[4], unsigned char const **nsfb) {
+  unsigned int sc = c->scalefac_compress, index;
+
+  index = c->block_type == 2 ? ((c->flags & mixed_block_flag) ? 2 : 1) : 0;
+  slen[2] = slen[3] = 0;
+
+  if (!is_right) {
+    if (sc < 400) {
+      slen[0] = (sc >> 4) / 5;
+      slen[1] = (sc >> 4) % 5;
+      slen[2] = (sc % 16) >> 2;
+      slen[3] = sc % 4;
+      *nsfb = nsfb_table[0][index];
+    }
+    else if (sc < 500) {
+      sc -= 400;
+      slen[0] = (sc >> 2) / 5;
+      slen[1] = (sc >> 2) % 5;
+      slen[2] = sc % 4;
+      *nsfb = nsfb_table[1][index];
+    }
+    else {
+      sc -= 500;
+      slen[0] = sc / 3;
+      slen[1] = sc % 3;
+      *nsfb = nsfb_table[2][index];
+    }
+  }
+  else {
+    sc >>= 1;
+    if (sc < 180) {
+      slen[0] = sc / 36;
+      slen[1] = (sc % 36) / 6;
+      slen[2] = (sc % 36) % 6;
+      *nsfb = nsfb_table[3][index];
+    }
+    else if (sc < 244) {
+      sc -= 180;
+      slen[0] = (sc % 64) >> 4;
+      slen[1] = (sc % 16) >> 2;
+      slen[2] = sc % 4;
+      *nsfb = nsfb_table[4][index];
+    }
+    else {
+      sc -= 244;
+      slen[0] = sc / 3;
+      slen[1] = sc % 3;
+      *nsfb = nsfb_table[5][index];
+    }
+  }
+}
+
+// scalefactors, as III_scalefactors() and III_scalefactors_lsf() read them
+static void III_put_scalefactors(gen_t *g, md_t *md, unsigned int gr, unsigned int ch) {
+  struct channel *c = &md->gch[gr][ch].c;
+  bits_t *b = &md->data;
+  unsigned int i, n = 0;
+
+  if (g->s->version != GEN_MPEG1) {
+    unsigned int slen[4], part;
+    unsigned char const *nsfb;
+
+    III_lsf_slen(c, ch == 1 && (md->mode_ext & I_STEREO), slen, &nsfb);
+    for (part = 0; part < 4; ++part) {
+      for (i = 0; i < nsfb[part]; ++i) {
+        c->scalefac[n] = rnd(1 << slen[part]);
+        put(b, c->scalefac[n++], slen[part]);
+      }
+    }
+  }
+  else if (c->block_type == 2) {
+    unsigned int slen1 = sflen_table[c->scalefac_compress].slen1;
+    unsigned int slen2 = sflen_table[c->scalefac_compress].slen2;
+    unsigned int n1 = (c->flags & mixed_block_flag) ? 8 + 3 * 3 : 6 * 3;
+
+    for (i = 0; i < n1 + 6 * 3; ++i) {
+      c->scalefac[i] = rnd(1 << (i < n1 ? slen1 : slen2));
+      put(b, c->scalefac[i], i < n1 ? slen1 : slen2);
+    }
+  }
+  else {
+    static unsigned char const start[5] = { 0, 6, 11, 16, 21 };
+    unsigned int scfsi = gr ? md->scfsi[ch] : 0, part;
+
+    for (part = 0; part < 4; ++part) {
+      unsigned int slen = part < 2 ? sflen_table[c->scalefac_compress].slen1 :
+                                     sflen_table[c->scalefac_compress].slen2;
+
+      for (i = start[part]; i < start[part + 1]; ++i) {
+        if (scfsi & (8 >> part)) {
+          c->scalefac[i] = md->gch[0][ch].c.scalefac[i];
+        }
+        else {
+          c->scalefac[i] = rnd(1 << slen);
+          put(b, c->scalefac[i], slen);
+        }
+      }
+    }
+  }
+}
+
+// the quantized lines of a granule channel, up to lines of them, and the
+// side info that codes them; peak is about the largest value
+static void III_lines(gen_t *g, gch_t *gch, unsigned char const *sfbwidth,
+                      unsigned int lines, unsigned int peak) {
+  struct channel *c = &gch->c;
+  unsigned int end[2], max[3] = { 0, 0, 0 }, nq, big, l, n, sfbi, r;
+
+  memset(gch->is, 0, sizeof(gch->is));
+
+  // big_values pairs, then count1 quads of values up to one
+  lines &= ~3U;
+  nq = rnd((lines / 4 < 40 ? lines / 4 : 40) + 1);
+  big = lines - 4 * nq;
+  for (l = 0; l < big; ++l) {
+    unsigned int cap = 1 + peak * (big - l) / big;
+
+    if (rnd(3)) {
+      gch->is[l] = (int)rnd(cap + 1) * (rnd(2) ? -1 : 1);
+    }
+  }
+  for (; l < lines; ++l) {
+    if (!rnd(3)) {
+      gch->is[l] = rnd(2) ? -1 : 1;
+    }
+  }
+  c->big_values = big / 2;
+  gch->count1 = lines;
+
+  // regions, the way III_huffdecode() counts them in scalefactor bands
+  if (c->block_type) {
+    c->region0_count = (c->block_type == 2 && !(c->flags & mixed_block_flag)) ? 8 : 7;
+    c->region1_count = 36;
+  }
+  else {
+    c->region0_count = rnd(16);
+    c->region1_count = rnd(8);
+  }
+  l = sfbi = 0;
+  for (n = c->region0_count + 1; n-- && l < 576; ) {
+    l += sfbwidth[sfbi++];
+  }
+  end[0] = l;
+  for (n = c->region1_count + 1; n-- && l < 576; ) {
+    l += sfbwidth[sfbi++];
+  }
+  end[1] = c->block_type ? 576 : l;
+
+  for (l = 0; l < big; ++l) {
+    unsigned int v = abs(gch->is[l]);
+
+    r = l < end[0] ? 0 : l < end[1] ? 1 : 2;
+    if (v > max[r]) {
+      max[r] = v;
+    }
+  }
+  for (r = 0; r < 3; ++r) {
+    c->table_select[r] = huffman_table(max[r]);
+  }
+
+  // loud enough to hear, never so loud as to clip much, unless asked to
+  if (g->s->flags & GEN_LOUD) {
+    // where III_requantize()'s overflow check falls, values on both sides of it
+    c->global_gain = 160 + rnd(32);
+  }
+  else {
+    c->global_gain = 197 - (unsigned int)(16.0 / 3 * log2(peak + 1)) - rnd(16);
+  }
+  for (r = 0; r < 3; ++r) {
+    c->subblock_gain[r] = c->block_type ? rnd(3) : 0;
+  }
+  c->flags = (c->flags & mixed_block_flag) | rnd(g->s->version == GEN_MPEG1 ? 8 : 4);
+}
+
+static void III_put_huffman(gch_t *gch, unsigned char const *sfbwidth, bits_t *b) {
+  struct channel const *c = &gch->c;
+  unsigned int end[2], l, n, sfbi;
+
+  l = sfbi = 0;
+  for (n = c->region0_count + 1; n-- && l < 576; ) {
+    l += sfbwidth[sfbi++];
+  }
+  end[0] = l;
+  for (n = c->region1_count + 1; n-- && l < 576; ) {
+    l += sfbwidth[sfbi++];
+  }
+  end[1] = l;
+
+  for (l = 0; l < 2U * c->big_values; l += 2) {
+    put_pair(b, c->table_select[l < end[0] ? 0 : l < end[1] ? 1 : 2], gch->is[l], gch->is[l + 1]);
+  }
+  for (; l < gch->count1; l += 4) {
+    put_quad(b, c->flags & count1table_select, &gch->is[l]);
+  }
+}
+
+// one frame's main data, in up to budget bits
+static void III_main_data(gen_t *g, md_t *md, unsigned long budget) {
+  static unsigned short const peaks[10] = { 1, 3, 7, 15, 15, 15, 60, 60, 200, 1000 };
+  stream_t const *s = g->s;
+  unsigned int ngr = s->version == GEN_MPEG1 ? 2 : 1, gr, ch, lines[2], peak[2];
+  unsigned int sfi = sfreqi(s);
+
+  md->mode_ext = 0;
+  if (s->mode == GEN_JOINT) {
+    md->mode_ext = ((s->flags & GEN_IS) && rnd(2) ? I_STEREO : 0) |
+                   ((s->flags & GEN_MS) && rnd(2) ? MS_STEREO : 0);
+  }
+  for (gr = 0; gr < ngr; ++gr) {
+    III_blocks(g, md, gr);
+  }
+  for (ch = 0; ch < g->nch; ++ch) {
+    md->scfsi[ch] = 0;
+    if (ngr == 2 && md->gch[0][ch].c.block_type != 2 && md->gch[1][ch].c.block_type != 2) {
+      md->scfsi[ch] = rnd(16);
+    }
+    lines[ch] = 64 + rnd(513);
+    peak[ch] = (s->flags & GEN_LOUD) ? 1000 + rnd(7192) : peaks[rnd(10)];
+  }
+
+  // the whole frame's worth in a fraction of the bits there are, fewer lines until it fits
+  budget = budget * (5 + rnd(6)) / 10;
+  while (1) {
+    unsigned int worst = 0;
+
+    md->data.bits = 0;
+    for (gr = 0; gr < ngr; ++gr) {
+      for (ch = 0; ch < g->nch; ++ch) {
+        gch_t *gch = &md->gch[gr][ch];
+        unsigned char const *sfbwidth = III_sfbwidth(sfi, &gch->c);
+        unsigned int n = lines[ch], start = md->data.bits;
+
+        // intensity stereo codes the right channel's upper bands as positions only
+        if (ch == 1 && (md->mode_ext & I_STEREO)) {
+          n = lines[0] * rnd(60) / 100;
+        }
+        gch->c.scalefac_compress = rnd(s->version == GEN_MPEG1 ? 16 : 512);
+        III_lines(g, gch, sfbwidth, n, peak[ch]);
+        III_put_scalefactors(g, md, gr, ch);
+        III_put_huffman(gch, sfbwidth, &md->data);
+        gch->c.part2_3_length = md->data.bits - start;
+        if (gch->c.part2_3_length > worst) {
+          worst = gch->c.part2_3_length;
+        }
+      }
+    }
+    if (md->data.bits <= budget && worst < 4096) {
+      break;
+    }
+    for (ch = 0; ch < g->nch; ++ch) {
+      lines[ch] = lines[ch] * 3 / 4;
+    }
+  }
+  put_zeros(&md->data, 0);
+}
+
+static void III_put_sideinfo(gen_t *g, md_t *md, bits_t *f, unsigned int main_data_begin) {
+  int lsf = g->s->version != GEN_MPEG1;
+  unsigned int ngr = lsf ? 1 : 2, gr, ch, i;
+
+  put(f, main_data_begin, lsf ? 8 : 9);
+  put(f, rnd(32), lsf ? (g->nch == 1 ? 1 : 2) : (g->nch == 1 ? 5 : 3));
+  if (!lsf) {
+    for (ch = 0; ch < g->nch; ++ch) {
+      put(f, md->scfsi[ch], 4);
+    }
+  }
+  for (gr = 0; gr < ngr; ++gr) {
+    for (ch = 0; ch < g->nch; ++ch) {
+      struct channel const *c = &md->gch[gr][ch].c;
+
+      put(f, c->part2_3_length, 12);
+      put(f, c->big_values, 9);
+      put(f, c->global_gain, 8);
+      put(f, c->scalefac_compress, lsf ? 9 : 4);
+      put(f, c->block_type != 0, 1);
+      if (c->block_type) {
+        put(f, c->block_type, 2);
+        put(f, !!(c->flags & mixed_block_flag), 1);
+        for (i = 0; i < 2; ++i) {
+          put(f, c->table_select[i], 5);
+        }
+        for (i = 0; i < 3; ++i) {
+          put(f, c->subblock_gain[i], 3);
+        }
+      }
+      else {
+        for (i = 0; i < 3; ++i) {
+          put(f, c->table_select[i], 5);
+        }
+        put(f, c->region0_count, 4);
+        put(f, c->region1_count, 3);
+      }
+      put(f, c->flags & (lsf ? 3 : 7), lsf ? 2 : 3);
+    }
+  }
+}
+
+/*
+ * Frame i carries the rest of main data i, after the main_data_begin bytes
+ * of it the frame before carried, then as much of main data i + 1 as fits
+ * and the reservoir allows. So main data i + 1 is made before frame i is
+ * written, for its main_data_begin, in what frame i leaves free and frame
+ * i + 1 has.
+ */
+static void layer_III(gen_t *g, bits_t *f, md_t *md, unsigned int *begin, unsigned long frames) {
+  int lsf = g->s->version != GEN_MPEG1;
+  unsigned int si_len = lsf ? (g->nch == 1 ? 9 : 17) : (g->nch == 1 ? 17 : 32);
+  unsigned int crc = (g->s->flags & GEN_CRC) ? 2 : 0;
+  unsigned int pad, next_pad, bytes = frame_bytes(g, g->frame, &pad);
+  unsigned int space = bytes - 4 - crc - si_len, len = md[0].data.bits / 8, room, next = 0;
+
+  // the first main data, before the first frame
+  if (g->frame == 0) {
+    III_main_data(g, &md[0], space * 8);
+    len = md[0].data.bits / 8;
+  }
+
+  room = space - (len - *begin);
+  if (room > (lsf ? 255U : 511U)) {
+    room = lsf ? 255 : 511;
+  }
+  if (g->frame + 1 < frames) {
+    unsigned int next_space = frame_bytes(g, g->frame + 1, &next_pad) - 4 - crc - si_len;
+
+    III_main_data(g, &md[1], (room + next_space) * 8);
+    next = md[1].data.bits / 8;
+    if (next > room) {
+      next = room;
+    }
+  }
+
+  g->mode_ext = md[0].mode_ext;
+  f->bits = 0;
+  put_header(g, f, pad);
+  III_put_sideinfo(g, &md[0], f, *begin);
+  put_crc(g, f, si_len * 8);
+
+  // the main data from the side info on, ancillary zeros, the next main data's start
+  f->bits = (4 + crc + si_len) * 8;
+  put_zeros(f, bytes);
+  memcpy(f->data + 4 + crc + si_len, md[0].data.data + *begin, len - *begin);
+  if (next) {
+    memcpy(f->data + bytes - next, md[1].data.data, next);
+  }
+  put_frame(g, f, bytes);
+
+  *begin = next;
+  md[0].data.bits = 0;
+  {
+    md_t swap = md[0];
+
+    md[0] = md[1];
+    md[1] = swap;
+  }
+}
+
+// --- Streams ----------------------------------------------------------------
+
+// a header in the frame's data that free_bitrate() could take for the next
+// frame's, same layer and sampling frequency (it only looks in the first)
+static int false_sync(gen_t const *g, unsigned long bytes) {
+  unsigned char const *p = g->out.data;
+  unsigned long i;
+
+  for (i = 4; i + 3 < bytes; ++i) {
+    if (p[i] == 0xff && (p[i + 1] & 0xe0) == 0xe0 &&
+        ((p[i + 1] ^ p[1]) & 0x1e) == 0 && ((p[i + 2] ^ p[2]) & 0x0c) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int generate(stream_t const *s, unsigned long frames, char const *path) {
+  static md_t md[2];
+  gen_t g;
+  bits_t f = { NULL, 0, 0 };
+  unsigned int row, pad, begin;
+  unsigned long attempt = 0, i;
+  FILE *out;
+
+  memset(&g, 0, sizeof(g));
+  g.s = s;
+  g.nch = s->mode == GEN_MONO ? 1 : 2;
+
+  row = s->version == GEN_MPEG1 ? s->layer - 1 : s->layer == 1 ? 3 : 4;
+  if (!(s->flags & GEN_FREE)) {
+    for (g.bitrate_index = 1; g.bitrate_index < 15 && kbps_table[row][g.bitrate_index] != s->kbps; ++g.bitrate_index) {
+    }
+    if (g.bitrate_index == 15) {
+      fprintf(stderr, "mpgen: %s: no %u kbps bitrate\n", s->name, s->kbps);
+      return 1;
+    }
+  }
+  else {
+    // free_bitrate() works the rate out from the frame length, it has to come out the same
+    unsigned int bytes = frame_bytes(&g, 0, &pad);
+    unsigned long per = (s->layer == 3 && s->version != GEN_MPEG1) ? 72 : 144;
+
+    if (s->layer == 1 || (unsigned long) s->samplerate * (bytes + 1) / per / 1000 != s->kbps) {
+      fprintf(stderr, "mpgen: %s: %u kbps can't be free format\n", s->name, s->kbps);
+      return 1;
+    }
+  }
+
+  do {
+    // the same content every time, for the same name
+    seed = 0x6d7067656eULL + attempt++;
+    for (i = 0; s->name[i]; ++i) {
+      seed = seed * 31 + (unsigned char) s->name[i];
+    }
+
+    g.out.bits = 0;
+    g.frame = 0;
+    g.last_block[0] = g.last_block[1] = 0;
+    begin = 0;
+    for (i = 0; i < frames; ++i) {
+      switch (s->layer) {
+      case 1:
+        layer_I(&g, &f);
+        break;
+      case 2:
+        layer_II(&g, &f);
+        break;
+      default:
+        layer_III(&g, &f, md, &begin, frames);
+      }
+    }
+  } while ((s->flags & GEN_FREE) && false_sync(&g, frame_bytes(&g, 0, &pad)));
+
+  if ((out = fopen(path, "wb")) == NULL || fwrite(g.out.data, 1, g.out.bits / 8, out) != g.out.bits / 8) {
+    perror(path);
+    return 1;
+  }
+  fclose(out);
+
+  free(g.out.data);
+  free(f.data);
+  return 0;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: mpgen [-n frames] [-l] dir [name...]\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  unsigned long frames = 64;
+  unsigned int i;
+  int opt, list = 0, failed = 0;
+  char path[1024];
+
+  while ((opt = getopt(argc, argv, "n:l")) != -1) {
+    switch (opt) {
+    case 'n':
+      frames = strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      list = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+
+  if (list) {
+    for (i = 0; i < NSTREAMS; ++i) {
+      printf("%-14s %s\n", streams[i].name, streams[i].covers);
+    }
+    return 0;
+  }
+  if (optind >= argc || frames == 0) {
+    usage();
+  }
+
+  huffman_init();
+
+  for (i = 0; i < NSTREAMS; ++i) {
+    // the loud streams overflow the 32-bit fixed point builds, they're only for 64-bit ones
+    int j, named = optind + 1 == argc && !(streams[i].flags & GEN_LOUD);
+
+    for (j = optind + 1; j < argc; ++j) {
+      named |= strcmp(argv[j], streams[i].name) == 0;
+    }
+    if (named) {
+      snprintf(path, sizeof(path), "%s/%s.mp3", argv[optind], streams[i].name);
+      failed |= generate(&streams[i], frames, path);
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,60 @@
+/*
+ * pcmcmp: compare raw 16-bit PCM against a reference
+ *
+ *   pcmcmp ref.pcm test.pcm
+ *
+ * Both are 16-bit little-endian samples, as `transcode -r` writes them.
+ * Prints the largest absolute difference between two samples, in LSB, and
+ * how many samples differ; exits with 1 if the lengths differ or a file
+ * can't be read. See regress.sh.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+  FILE *ref, *test;
+  unsigned char a[2], b[2];
+  unsigned long samples = 0, differ = 0;
+  int max = 0;
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: pcmcmp ref.pcm test.pcm\n");
+    return 2;
+  }
+  if ((ref = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  if ((test = fopen(argv[2], "rb")) == NULL) {
+    perror(argv[2]);
+    return 1;
+  }
+
+  while (1) {
+    size_t n = fread(a, 1, 2, ref), m = fread(b, 1, 2, test);
+    int diff;
+
+    if (n != m) {
+      fprintf(stderr, "pcmcmp: %s and %s differ in length after %lu samples\n", argv[1], argv[2], samples);
+      return 1;
+    }
+    if (n < 2) {
+      break;
+    }
+    diff = abs((signed short)(a[0] | a[1] << 8) - (signed short)(b[0] | b[1] << 8));
+    if (diff) {
+      differ++;
+      if (diff > max) {
+        max = diff;
+      }
+    }
+    samples++;
+  }
+
+  printf("%d %lu\n", max, differ);
+
+  fclose(ref);
+  fclose(test);
+
+  return 0;
+}
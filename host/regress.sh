@@ -0,0 +1,103 @@
+#!/bin/sh
+#
+# PCM regression over the libmad builds: decode each stream listed in
+# regress.txt with each build, and compare the output's checksum with the
+# one recorded there, and its largest difference from a reference build's
+# output with the budget recorded there. Run by `make -C host regress`.
+#
+#   ./regress.sh        check, exit 1 on any difference
+#   ./regress.sh -u     check the budgets only, and record the checksums
+#
+# Each line of regress.txt is
+#
+#   name  flags  options  ref  budget  stream  checksum
+#
+# flags: the FPM_/OPT_ build flags, comma separated
+# options: MAD_OPTION_* bits to decode with (transcode -O)
+# ref: the name of an earlier line to compare the PCM with, - for none
+# budget: the largest difference from ref allowed, in LSB
+# stream: relative to host/, or a pattern for several, decoded one after
+#   the other into one PCM (streams/*.mp3 are mpgen's, see `make streams`)
+# checksum: cksum of the 16-bit PCM, - until it's recorded
+
+cd "$(dirname "$0")" || exit 2
+
+update=0
+if [ "$1" = "-u" ]; then
+  update=1
+fi
+
+dir=regress.out
+mkdir -p $dir
+make -s pcmcmp streams > /dev/null || exit 2
+
+failed=0
+: > $dir/regress.txt
+
+while IFS= read -r line; do
+  case "$line" in
+    ""|"#"*)
+      echo "$line" >> $dir/regress.txt
+      continue
+      ;;
+  esac
+  set -f  # the stream may be a pattern, expanded when it's decoded
+  set -- $line
+  set +f
+  name=$1 flags=$2 options=$3 ref=$4 budget=$5 stream=$6 sum=$7
+
+  # one transcode for each set of flags
+  bin=$dir/transcode$(echo "$flags" | tr -c 'A-Za-z0-9\n' '_')
+  if ! make -s TRANSCODE=$bin FPM="$(echo "$flags" | tr , ' ')" OPT= $bin; then
+    echo "$name: build with $flags failed"
+    failed=1
+    echo "$line" >> $dir/regress.txt
+    continue
+  fi
+
+  pcm=$dir/$name.pcm
+  result=ok
+  : > $pcm
+  for f in $stream; do
+    if ! ./$bin -j 1 -r -O "$options" "$f" $dir/stream.pcm 2> /dev/null; then
+      result="FAIL: decoding $f failed"
+      break
+    fi
+    cat $dir/stream.pcm >> $pcm
+  done
+  if [ "$result" != ok ]; then
+    got=-
+  else
+    got=$(cksum < $pcm | cut -d ' ' -f 1)
+    if [ "$ref" != - ]; then
+      if set -- $(./pcmcmp $dir/$ref.pcm $pcm); then
+        result="ok, error $1 LSB in $2 samples"
+        if [ "$1" -gt "$budget" ]; then
+          result="FAIL: error $1 LSB over the budget of $budget"
+        fi
+      else
+        result="FAIL: not comparable with $ref"
+      fi
+    fi
+    if [ $update = 0 ] && [ "$got" != "$sum" ]; then
+      result="FAIL: checksum $got, not $sum ($result)"
+    fi
+  fi
+  case "$result" in
+    FAIL*) failed=1 ;;
+  esac
+  printf "%-18s %-16s %s\n" "$name" "$stream" "$result"
+
+  printf "%-18s %-28s %-3s %-10s %-3s %-28s %s\n" \
+    "$name" "$flags" "$options" "$ref" "$budget" "$stream" "$got" >> $dir/regress.txt
+done < regress.txt
+
+if [ $update = 1 ]; then
+  if [ $failed = 1 ]; then
+    echo "regress.sh: not recording checksums while a build is over its budget"
+  else
+    cp $dir/regress.txt regress.txt
+  fi
+fi
+
+exit $failed
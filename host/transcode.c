@@ -0,0 +1,307 @@
+/*
+ * transcode: frame-parallel mp3 to WAV decoder for the host
+ *
+ *   transcode [-j threads] [-r] [-O options] in.mp3 out.wav
+ *
+ * The input is split at frame boundaries (see split.c) into one chunk per
+ * thread, each chunk is decoded on its own thread with a few frames of
+ * warm-up in front of it, and the PCM is stitched back together. The
+ * output is identical to decoding the file on one thread, which `make test`
+ * checks. -r writes raw 16-bit little-endian interleaved PCM instead of WAV,
+ * and -O decodes with MAD_OPTION_* flags (a number).
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mad.h"
+#include "split.h"
+
+typedef struct {
+  unsigned char const *buf;
+  split_chunk_t chunk;
+  int options;
+
+  // decoded output
+  unsigned char *pcm;
+  unsigned long size;
+  unsigned long alloc;
+  unsigned long frames;
+  unsigned long errors;
+  struct mad_header header;  // of the first frame kept
+  unsigned int samplerate;   // of its PCM, less than the header's at a reduced rate
+  int error;
+} job_t;
+
+// caller-owned libmad storage for one decoder
+typedef struct {
+  unsigned char main_data[MAD_BUFFER_MDLEN];
+  mad_fixed_t sbsample[2][36][32];
+  mad_fixed_t overlap[2][32][18];
+  mad_fixed_t filter[2][2][2][16][8];
+  signed short pcm[2][1152];
+} storage_t;
+
+static int append(job_t *job, struct mad_pcm const *pcm) {
+  unsigned long bytes = (unsigned long)pcm->length * pcm->channels * 2;
+
+  if (job->size + bytes > job->alloc) {
+    unsigned long alloc = job->alloc ? job->alloc * 2 : 1 << 20;
+    unsigned char *p;
+    while (alloc < job->size + bytes) {
+      alloc *= 2;
+    }
+    if ((p = realloc(job->pcm, alloc)) == NULL) {
+      return -1;
+    }
+    job->pcm = p;
+    job->alloc = alloc;
+  }
+
+  unsigned char *out = job->pcm + job->size;
+  for (unsigned int i = 0; i < pcm->length; i++) {
+    for (unsigned int ch = 0; ch < pcm->channels; ch++) {
+      signed short sample = pcm->samples[ch][i];
+      *out++ = sample & 0xff;
+      *out++ = (sample >> 8) & 0xff;
+    }
+  }
+  job->size += bytes;
+
+  return 0;
+}
+
+static void *decode_chunk(void *arg) {
+  job_t *job = arg;
+  storage_t *storage;
+  struct mad_stream stream;
+  struct mad_frame frame;
+  struct mad_synth synth;
+  unsigned char const *start = job->buf + job->chunk.start;
+
+  if ((storage = malloc(sizeof(*storage))) == NULL) {
+    job->error = -1;
+    return NULL;
+  }
+
+  mad_stream_init(&stream, (unsigned char *)start);
+  mad_frame_init(&frame);
+  mad_synth_init(&synth);
+  mad_stream_attach(&stream, storage->main_data);
+  mad_frame_attach(&frame, 2, storage->sbsample, storage->overlap);
+  mad_synth_attach(&synth, 2, storage->filter, storage->pcm);
+  stream.options = job->options;
+
+  // the whole rest of the file is in memory, the chunk ends at the first frame past its end
+  mad_stream_buffer(&stream, (unsigned char *)start, job->chunk.end - job->chunk.start + MAD_BUFFER_GUARD);
+
+  while (1) {
+    if (mad_frame_decode(&frame, &stream) == -1) {
+      if (stream.this_frame - job->buf >= job->chunk.end || !MAD_RECOVERABLE(stream.error)) {
+        break;
+      }
+      if (stream.this_frame - job->buf >= job->chunk.first) {
+        job->errors++;
+      }
+      continue;
+    }
+    if (stream.this_frame - job->buf >= job->chunk.end) {
+      break;
+    }
+
+    mad_synth_frame(&synth, &frame);
+
+    // the warm-up frames only bring the decoder state up to date
+    if (stream.this_frame - job->buf < job->chunk.first) {
+      continue;
+    }
+    if (job->frames++ == 0) {
+      job->header = frame.header;
+      job->samplerate = synth.pcm.samplerate;
+    }
+    if (append(job, &synth.pcm) == -1) {
+      job->error = -1;
+      break;
+    }
+  }
+
+  mad_synth_finish(&synth);
+  mad_frame_finish(&frame);
+  mad_stream_finish(&stream);
+  free(storage);
+
+  return NULL;
+}
+
+static void put_le(unsigned char *p, unsigned long value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    p[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+static void wav_header(unsigned char header[44], unsigned long size, unsigned int channels, unsigned int rate) {
+  memcpy(header, "RIFF", 4);
+  put_le(header + 4, 36 + size, 4);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  put_le(header + 16, 16, 4);
+  put_le(header + 20, 1, 2);  // PCM
+  put_le(header + 22, channels, 2);
+  put_le(header + 24, rate, 4);
+  put_le(header + 28, rate * channels * 2, 4);
+  put_le(header + 32, channels * 2, 2);
+  put_le(header + 34, 16, 2);
+  memcpy(header + 36, "data", 4);
+  put_le(header + 40, size, 4);
+}
+
+static unsigned char *read_file(char const *path, unsigned long *len) {
+  FILE *f = fopen(path, "rb");
+  unsigned char *buf = NULL;
+  long size;
+
+  if (f == NULL) {
+    return NULL;
+  }
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+    // zeroed guard bytes after the last frame, as libmad reads a little past it
+    if ((buf = calloc(size + MAD_BUFFER_GUARD, 1)) != NULL && fread(buf, 1, size, f) != (size_t)size) {
+      free(buf);
+      buf = NULL;
+    }
+    *len = size;
+  }
+  fclose(f);
+
+  return buf;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: transcode [-j threads] [-r] [-O options] in.mp3 out.wav\n");
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int raw = 0, options = 0, opt, result = 0;
+  unsigned char *buf;
+  unsigned long len, frames, *offset;
+  split_chunk_t *chunk;
+  job_t *job;
+  pthread_t *thread;
+  unsigned int count;
+  double t0, t1, t2;
+  FILE *out;
+
+  while ((opt = getopt(argc, argv, "j:rO:")) != -1) {
+    switch (opt) {
+      case 'j':
+        threads = atol(optarg);
+        break;
+      case 'r':
+        raw = 1;
+        break;
+      case 'O':
+        options = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (argc - optind != 2 || threads < 1) {
+    usage();
+  }
+
+  if ((buf = read_file(argv[optind], &len)) == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  t0 = now();
+  frames = split_scan(buf, len, NULL, 0);
+  offset = malloc((frames + 1) * sizeof(*offset));
+  chunk = malloc(threads * sizeof(*chunk));
+  job = calloc(threads, sizeof(*job));
+  thread = malloc(threads * sizeof(*thread));
+  if (offset == NULL || chunk == NULL || job == NULL || thread == NULL) {
+    fprintf(stderr, "transcode: out of memory\n");
+    return 1;
+  }
+  split_scan(buf, len, offset, frames);
+  count = split_chunks(offset, frames, len, threads, chunk);
+
+  t1 = now();
+  for (unsigned int i = 0; i < count; i++) {
+    job[i].buf = buf;
+    job[i].chunk = chunk[i];
+    job[i].options = options;
+    if (pthread_create(&thread[i], NULL, decode_chunk, &job[i]) != 0) {
+      // decode it here instead
+      decode_chunk(&job[i]);
+      thread[i] = pthread_self();
+    }
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    if (!pthread_equal(thread[i], pthread_self())) {
+      pthread_join(thread[i], NULL);
+    }
+  }
+  t2 = now();
+
+  if ((out = fopen(argv[optind + 1], "wb")) == NULL) {
+    perror(argv[optind + 1]);
+    return 1;
+  }
+
+  unsigned long size = 0, decoded = 0, errors = 0;
+  struct mad_header const *header = NULL;
+  unsigned int samplerate = 44100;
+  for (unsigned int i = 0; i < count; i++) {
+    if (job[i].error) {
+      fprintf(stderr, "transcode: out of memory\n");
+      result = 1;
+    }
+    if (header == NULL && job[i].frames) {
+      header = &job[i].header;
+      samplerate = job[i].samplerate;
+    }
+    size += job[i].size;
+    decoded += job[i].frames;
+    errors += job[i].errors;
+  }
+
+  if (!raw) {
+    unsigned char wav[44];
+    wav_header(wav, size, header ? MAD_NCHANNELS(header) : 2, samplerate);
+    fwrite(wav, 1, sizeof(wav), out);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    if (job[i].size && fwrite(job[i].pcm, 1, job[i].size, out) != job[i].size) {
+      result = 1;
+    }
+    free(job[i].pcm);
+  }
+  if (fclose(out) != 0 || result) {
+    fprintf(stderr, "transcode: failed writing %s\n", argv[optind + 1]);
+    return 1;
+  }
+
+  fprintf(stderr, "%lu frames (%lu decoded, %lu errors) in %u chunks, scan %.3fs, decode %.3fs\n",
+          frames, decoded, errors, count, t1 - t0, t2 - t1);
+
+  free(thread);
+  free(job);
+  free(chunk);
+  free(offset);
+  free(buf);
+
+  return 0;
+}
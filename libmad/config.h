@@ -1,7 +1,9 @@
 /* config.h.  Generated by configure.  */
 
-/* Include the MicroPython dynamic runtime */
-#include <py/dynruntime.h>
+/* Include the MicroPython dynamic runtime, unless building the host tools */
+#if !defined(MAD_HOST)
+# include <py/dynruntime.h>
+#endif
 
 /* Define to enable diagnostic debugging support. */
 /* #undef DEBUG */
@@ -46,17 +48,17 @@
 #undef NDEBUG
 
 /* Define to optimize for accuracy over speed. */
-#undef OPT_ACCURACY
+/* #undef OPT_ACCURACY -- set with OPT in the Makefile */
 
 /* Define to optimize for speed over accuracy. */
-#undef OPT_SPEED
+/* #undef OPT_SPEED -- set with OPT in the Makefile */
 
 /* Define to enable a fast subband synthesis approximation optimization. */
-#undef OPT_SSO
+/* #undef OPT_SSO -- set with OPT in the Makefile */
 
 /* Define to influence a strict interpretation of the ISO/IEC standards, even
    if this is in opposition with best accepted practices. */
-#undef OPT_STRICT
+/* #undef OPT_STRICT -- set with OPT in the Makefile */
 
 /* Name of package */
 #define PACKAGE "libmad"
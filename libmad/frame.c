@@ -94,6 +94,28 @@ void mad_frame_init(struct mad_frame *frame)
 
   frame->options = 0;
 
+  frame->nch      = 0;
+  frame->sbsample = 0;
+  frame->overlap  = 0;
+
+  frame->stage    = 0;
+  frame->stats    = 0;
+  frame->sblimit  = 32;
+}
+
+/*
+ * NAME:	frame->attach()
+ * DESCRIPTION:	give the frame caller-owned storage for nch channels
+ *		(overlap may be null if no Layer III frames will be decoded)
+ */
+void mad_frame_attach(struct mad_frame *frame, unsigned int nch,
+		      mad_fixed_t (*sbsample)[36][32],
+		      mad_fixed_t (*overlap)[32][18])
+{
+  frame->nch      = nch;
+  frame->sbsample = sbsample;
+  frame->overlap  = overlap;
+
   mad_frame_mute(frame);
 }
 
@@ -306,6 +328,7 @@ int mad_header_decode(struct mad_header *header, struct mad_stream *stream)
   if (stream->sync) {
     if (end - ptr < MAD_BUFFER_GUARD) {
       stream->next_frame = ptr;
+      stream->need = MAD_BUFFER_GUARD;
 
       stream->error = MAD_ERROR_BUFLEN;
       goto fail;
@@ -325,6 +348,7 @@ int mad_header_decode(struct mad_header *header, struct mad_stream *stream)
     if (mad_stream_sync(stream) == -1) {
       if (end - stream->next_frame >= MAD_BUFFER_GUARD)
         stream->next_frame = end - MAD_BUFFER_GUARD;
+      stream->need = MAD_BUFFER_GUARD + 1;
 
       stream->error = MAD_ERROR_BUFLEN;
       goto fail;
@@ -371,6 +395,7 @@ int mad_header_decode(struct mad_header *header, struct mad_stream *stream)
   /* verify there is enough data left in buffer to decode this frame */
   if (N + MAD_BUFFER_GUARD > end - stream->this_frame) {
     stream->next_frame = stream->this_frame;
+    stream->need = N + MAD_BUFFER_GUARD;
 
     stream->error = MAD_ERROR_BUFLEN;
     goto fail;
@@ -419,6 +444,15 @@ int mad_frame_decode(struct mad_frame *frame, struct mad_stream *stream)
 
   frame->header.flags &= ~MAD_FLAG_INCOMPLETE;
 
+  /* the caller must have attached storage for this layer and mode */
+
+  if (MAD_NCHANNELS(&frame->header) > frame->nch ||
+      (frame->header.layer == MAD_LAYER_III &&
+       (frame->overlap == 0 || stream->main_data == 0))) {
+    stream->error = MAD_ERROR_NOMEM;
+    goto fail;
+  }
+
   if (decoder_table[frame->header.layer - 1](stream, frame) == -1) {
     if (!MAD_RECOVERABLE(stream->error))
       stream->next_frame = stream->this_frame;
@@ -452,19 +486,19 @@ int mad_frame_decode(struct mad_frame *frame, struct mad_stream *stream)
  */
 void mad_frame_mute(struct mad_frame *frame)
 {
-  unsigned int s, sb;
+  unsigned int ch, s, sb;
 
-  for (s = 0; s < 36; ++s) {
-    for (sb = 0; sb < 32; ++sb) {
-      frame->sbsample[0][s][sb] =
-      frame->sbsample[1][s][sb] = 0;
+  for (ch = 0; ch < frame->nch; ++ch) {
+    for (s = 0; s < 36; ++s) {
+      for (sb = 0; sb < 32; ++sb)
+	frame->sbsample[ch][s][sb] = 0;
     }
-  }
 
-  for (s = 0; s < 18; ++s) {
-    for (sb = 0; sb < 32; ++sb) {
-      frame->overlap[0][sb][s] =
-      frame->overlap[1][sb][s] = 0;
+    if (frame->overlap) {
+      for (s = 0; s < 18; ++s) {
+	for (sb = 0; sb < 32; ++sb)
+	  frame->overlap[ch][sb][s] = 0;
+      }
     }
   }
 }
@@ -25,6 +25,7 @@
 # include "fixed.h"
 # include "timer.h"
 # include "stream.h"
+# include "stats.h"
 
 enum mad_layer {
   MAD_LAYER_I   = 1,			/* Layer I */
@@ -69,8 +70,18 @@ struct mad_frame {
 
   int options;				/* decoding options (from stream) */
 
-  mad_fixed_t sbsample[2][36][32];	/* synthesis subband filter samples */
-  mad_fixed_t overlap[2][32][18];	/* Layer III block overlap data */
+  /* caller-owned storage, see mad_frame_attach() */
+  unsigned int nch;			/* channels of storage attached */
+  mad_fixed_t (*sbsample)[36][32];	/* synthesis subband filter samples */
+  mad_fixed_t (*overlap)[32][18];	/* Layer III block overlap data */
+
+  void *stage;				/* Layer III first stage output, */
+					/* see mad_layer_III_stage2() */
+
+  unsigned int sblimit;			/* Layer III subbands to IMDCT, */
+					/* the rest fade out (32 for all) */
+
+  struct mad_stats *stats;		/* stage timing, see stats.h */
 };
 
 # define MAD_NCHANNELS(header)		((header)->mode ? 2 : 1)
@@ -109,6 +120,8 @@ void mad_header_init(struct mad_header *);
 int mad_header_decode(struct mad_header *, struct mad_stream *);
 
 void mad_frame_init(struct mad_frame *);
+void mad_frame_attach(struct mad_frame *, unsigned int,
+		      mad_fixed_t (*)[36][32], mad_fixed_t (*)[32][18]);
 void mad_frame_finish(struct mad_frame *);
 
 int mad_frame_decode(struct mad_frame *, struct mad_stream *);
@@ -25,6 +25,8 @@
 
 # include "global.h"
 
+# include <string.h>
+
 # include "huffman.h"
 
 /*
@@ -3107,3 +3109,89 @@ struct hufftable const mad_huff_pair_table[32] = {
   /* 30 */ { hufftab24, 11, 4 },
   /* 31 */ { hufftab24, 13, 4 }
 };
+
+/* active tables, see mad_huff_pin() */
+
+union huffquad const *const *mad_huff_quad = mad_huff_quad_table;
+struct hufftable const *mad_huff_pair = mad_huff_pair_table;
+
+/* every distinct code table, in the order they are copied */
+
+static
+struct {
+  void const *table;
+  unsigned short size;
+} const hufftabs[] = {
+  { hufftabA,  sizeof(hufftabA)  }, { hufftabB,  sizeof(hufftabB)  },
+  { hufftab0,  sizeof(hufftab0)  }, { hufftab1,  sizeof(hufftab1)  },
+  { hufftab2,  sizeof(hufftab2)  }, { hufftab3,  sizeof(hufftab3)  },
+  { hufftab5,  sizeof(hufftab5)  }, { hufftab6,  sizeof(hufftab6)  },
+  { hufftab7,  sizeof(hufftab7)  }, { hufftab8,  sizeof(hufftab8)  },
+  { hufftab9,  sizeof(hufftab9)  }, { hufftab10, sizeof(hufftab10) },
+  { hufftab11, sizeof(hufftab11) }, { hufftab12, sizeof(hufftab12) },
+  { hufftab13, sizeof(hufftab13) }, { hufftab15, sizeof(hufftab15) },
+  { hufftab16, sizeof(hufftab16) }, { hufftab24, sizeof(hufftab24) }
+};
+
+# define NHUFFTABS	(sizeof(hufftabs) / sizeof(hufftabs[0]))
+
+/*
+ * NAME:	huff->pin()
+ * DESCRIPTION:	copy the Huffman tables into a RAM block (or restore the
+ *		built-in tables if block is null); return the bytes needed
+ */
+unsigned long mad_huff_pin(unsigned char *block)
+{
+  unsigned char *copy[NHUFFTABS];
+  union huffquad const **quad;
+  struct hufftable *pair;
+  unsigned long size;
+  unsigned int i, j;
+
+  /* pair and quad index tables first, keeping pointers aligned */
+  size = sizeof(mad_huff_pair_table) + sizeof(mad_huff_quad_table);
+  for (i = 0; i < NHUFFTABS; ++i)
+    size += hufftabs[i].size;
+
+  if (block == 0) {
+    mad_huff_quad = mad_huff_quad_table;
+    mad_huff_pair = mad_huff_pair_table;
+
+    return size;
+  }
+
+  pair = (struct hufftable *) block;
+  block += sizeof(mad_huff_pair_table);
+
+  quad = (union huffquad const **) block;
+  block += sizeof(mad_huff_quad_table);
+
+  for (i = 0; i < NHUFFTABS; ++i) {
+    memcpy(block, hufftabs[i].table, hufftabs[i].size);
+    copy[i] = block;
+    block  += hufftabs[i].size;
+  }
+
+  for (j = 0; j < 32; ++j) {
+    pair[j] = mad_huff_pair_table[j];
+
+    for (i = 0; i < NHUFFTABS; ++i) {
+      if (pair[j].table == hufftabs[i].table)
+	pair[j].table = (union huffpair const *) copy[i];
+    }
+  }
+
+  for (j = 0; j < 2; ++j) {
+    quad[j] = mad_huff_quad_table[j];
+
+    for (i = 0; i < NHUFFTABS; ++i) {
+      if (quad[j] == hufftabs[i].table)
+	quad[j] = (union huffquad const *) copy[i];
+    }
+  }
+
+  mad_huff_quad = quad;
+  mad_huff_pair = pair;
+
+  return size;
+}
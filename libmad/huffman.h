@@ -63,4 +63,9 @@ struct hufftable {
 extern union huffquad const *const mad_huff_quad_table[2];
 extern struct hufftable const mad_huff_pair_table[32];
 
+extern union huffquad const *const *mad_huff_quad;
+extern struct hufftable const *mad_huff_pair;
+
+unsigned long mad_huff_pin(unsigned char *);
+
 # endif
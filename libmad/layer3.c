@@ -328,13 +328,25 @@ unsigned char const pretab[22] = {
  * table for requantization
  *
  * rq_table[x].mantissa * 2^(rq_table[x].exponent) = x^(4/3)
+ *
+ * With OPT_RQ_COMPACT only the first RQ_COMPACT entries are kept and larger
+ * values are interpolated by III_rqpower().
  */
+# if defined(OPT_RQ_COMPACT)
+#  define RQ_COMPACT	256
+# endif
+
 static
 struct fixedfloat {
   unsigned long mantissa  : 27;
   unsigned short exponent :  5;
+# if defined(OPT_RQ_COMPACT)
+} const rq_table[RQ_COMPACT] = {
+#  include "rq_compact.dat"
+# else
 } const rq_table[8207] = {
-# include "rq_table.dat"
+#  include "rq_table.dat"
+# endif
 };
 
 /*
@@ -438,6 +450,25 @@ mad_fixed_t const window_s[12] = {
   MAD_F(0x061f78aa) /* 0.382683432 */, MAD_F(0x0216a2a2) /* 0.130526192 */,
 };
 
+/*
+ * IMDCT tables as seen by the kernels; mad_layer_III_pin() can point these
+ * at a copy in RAM
+ */
+static
+struct {
+# if !defined(ASO_IMDCT)
+  mad_fixed_t const *window_l;
+# endif
+  mad_fixed_t const *window_s;
+  mad_fixed_t const (*imdct_s)[6];
+} III_tables = {
+# if !defined(ASO_IMDCT)
+  window_l,
+# endif
+  window_s,
+  imdct_s
+};
+
 /*
  * coefficients for intensity stereo processing
  * derived from section 2.4.3.4.9.3 of ISO/IEC 11172-3
@@ -875,23 +906,75 @@ void III_exponents(struct channel const *channel,
   }
 }
 
+# if defined(OPT_RQ_COMPACT)
+/*
+ * NAME:	III_rqpower()
+ * DESCRIPTION:	approximate value^(4/3) for values beyond the compact table
+ *
+ * Since (y * 8^k)^(4/3) == y^(4/3) * 2^(4k), value is scaled down by 8 or 64
+ * into the table and the fractional position is interpolated with a
+ * quadratic through the three nearest entries. Against the full rq_table
+ * the relative error is below 5.4e-7 (about -125 dB), well under the
+ * quantization step of any value large enough to take this path.
+ */
+static
+unsigned long III_rqpower(unsigned int value, signed int *exp)
+{
+  struct fixedfloat const *power;
+  unsigned int shift, f;
+  signed long m0, m1, m2, d1, d2, m;
+
+  /* keep y + 2 inside the table */
+  shift = (value < (RQ_COMPACT - 3) << 3) ? 3 : 6;
+  f     = value & ((1 << shift) - 1);
+
+  power = &rq_table[value >> shift];
+
+  /* bring the neighbours to the exponent of the first entry */
+  m0 = power[0].mantissa;
+  m1 = power[1].mantissa << (power[1].exponent - power[0].exponent);
+  m2 = power[2].mantissa << (power[2].exponent - power[0].exponent);
+
+  d1 = m1 - m0;
+  d2 = m2 - 2 * m1 + m0;
+
+  *exp += power[0].exponent + (shift / 3) * 4;
+
+  m = m0 + ((d1 * (signed long) f) >> shift) +
+    ((d2 * ((signed long) f * ((signed long) f - (1 << shift)))) >>
+     (2 * shift + 1));
+
+  /* back into the table's 27 bits, so the overflow check sees the same exponent */
+  while (m >= 1L << 27) {
+    m = (m + 1) >> 1;
+    ++*exp;
+  }
+
+  return m;
+}
+# endif
+
 /*
  * NAME:	III_requantize()
  * DESCRIPTION:	requantize one (positive) value
+ *		(exp and frac are the integer and quarter powers of two)
  */
 static
-mad_fixed_t III_requantize(unsigned int value, signed int exp)
+mad_fixed_t III_requantize(unsigned int value, signed int exp, signed int frac)
 {
   mad_fixed_t requantized;
-  signed int frac;
   struct fixedfloat const *power;
 
-  frac = exp % 4;  /* assumes sign(frac) == sign(exp) */
-  exp /= 4;
-
-  power = &rq_table[value];
-  requantized = power->mantissa;
-  exp += power->exponent;
+# if defined(OPT_RQ_COMPACT)
+  if (value >= RQ_COMPACT)
+    requantized = III_rqpower(value, &exp);
+  else
+# endif
+  {
+    power = &rq_table[value];
+    requantized = power->mantissa;
+    exp += power->exponent;
+  }
 
   if (exp < 0) {
     if (-exp >= sizeof(mad_fixed_t) * CHAR_BIT) {
@@ -919,6 +1002,92 @@ mad_fixed_t III_requantize(unsigned int value, signed int exp)
   return frac ? mad_f_mul(requantized, root_table[3 + frac]) : requantized;
 }
 
+/*
+ * requantization engine
+ *
+ * Most big_values and count1 magnitudes are small, so III_huffdecode()
+ * keeps a direct table of the first RQ_DIRECT requantized magnitudes for
+ * each of the last RQ_SLOTS scalefactor band exponents. Short blocks cycle
+ * through three window exponents, so a single table would be thrown away
+ * at almost every band boundary. Larger values use III_requantize().
+ */
+# define RQ_DIRECT	32
+# define RQ_SLOTS	4
+
+struct rqtable {
+  signed int exp;			/* exponent the table belongs to */
+  signed int shift;			/* exp / 4 */
+  signed int frac;			/* exp % 4 */
+  unsigned long valid;			/* mask of computed magnitudes */
+  mad_fixed_t magnitude[RQ_DIRECT];	/* requantized 0..RQ_DIRECT-1 */
+};
+
+struct rqengine {
+  unsigned int next;			/* next slot to replace */
+  struct rqtable slot[RQ_SLOTS];
+};
+
+/*
+ * NAME:	III_rqinit()
+ * DESCRIPTION:	invalidate all requantization tables
+ */
+static inline
+void III_rqinit(struct rqengine *rq)
+{
+  unsigned int i;
+
+  rq->next = 0;
+
+  for (i = 0; i < RQ_SLOTS; ++i)
+    rq->slot[i].valid = 0;
+}
+
+/*
+ * NAME:	III_rqselect()
+ * DESCRIPTION:	return the requantization table for an exponent
+ */
+static inline
+struct rqtable *III_rqselect(struct rqengine *rq, signed int exp)
+{
+  struct rqtable *table;
+  unsigned int i;
+
+  for (i = 0; i < RQ_SLOTS; ++i) {
+    table = &rq->slot[i];
+    if (table->valid && table->exp == exp)
+      return table;
+  }
+
+  table = &rq->slot[rq->next];
+  rq->next = (rq->next + 1) % RQ_SLOTS;
+
+  table->exp   = exp;
+  table->shift = exp / 4;
+  table->frac  = exp % 4;  /* assumes sign(frac) == sign(exp) */
+  table->valid = 1;  /* 0 requantizes to 0 */
+  table->magnitude[0] = 0;
+
+  return table;
+}
+
+/*
+ * NAME:	III_rqlookup()
+ * DESCRIPTION:	requantize one (positive) value using a direct table
+ */
+static inline
+mad_fixed_t III_rqlookup(struct rqtable *table, unsigned int value)
+{
+  if (value >= RQ_DIRECT)
+    return III_requantize(value, table->shift, table->frac);
+
+  if (!(table->valid & (1UL << value))) {
+    table->valid |= 1UL << value;
+    table->magnitude[value] = III_requantize(value, table->shift, table->frac);
+  }
+
+  return table->magnitude[value];
+}
+
 /* we must take care that sz >= bits and sz < sizeof(long) lest bits == 0 */
 # define MASK(cache, sz, bits)	\
     (((cache) >> ((sz) - (bits))) & ((1 << (bits)) - 1))
@@ -937,6 +1106,8 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 {
   signed int exponents[39], exp;
   signed int const *expptr;
+  struct rqengine rq;
+  struct rqtable *rqtab;
   struct mad_bitptr peek;
   signed int bits_left, cachesz;
   register mad_fixed_t *xrptr;
@@ -948,6 +1119,7 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
     return MAD_ERROR_BADPART3LEN;
 
   III_exponents(channel, sfbwidth, exponents);
+  III_rqinit(&rq);
 
   peek = *ptr;
   mad_bit_skip(ptr, bits_left);
@@ -966,13 +1138,12 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
     unsigned int region, rcount;
     struct hufftable const *entry;
     union huffpair const *table;
-    unsigned int linbits, startbits, big_values, reqhits;
-    mad_fixed_t reqcache[16];
+    unsigned int linbits, startbits, big_values;
 
     sfbound = xrptr + *sfbwidth++;
     rcount  = channel->region0_count + 1;
 
-    entry     = &mad_huff_pair_table[channel->table_select[region = 0]];
+    entry     = &mad_huff_pair[channel->table_select[region = 0]];
     table     = entry->table;
     linbits   = entry->linbits;
     startbits = entry->startbits;
@@ -982,7 +1153,7 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 
     expptr  = &exponents[0];
     exp     = *expptr++;
-    reqhits = 0;
+    rqtab   = III_rqselect(&rq, exp);
 
     big_values = channel->big_values;
 
@@ -1002,7 +1173,7 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	  else
 	    rcount = 0;  /* all remaining */
 
-	  entry     = &mad_huff_pair_table[channel->table_select[++region]];
+	  entry     = &mad_huff_pair[channel->table_select[++region]];
 	  table     = entry->table;
 	  linbits   = entry->linbits;
 	  startbits = entry->startbits;
@@ -1012,8 +1183,8 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	}
 
 	if (exp != *expptr) {
-	  exp = *expptr;
-	  reqhits = 0;
+	  exp   = *expptr;
+	  rqtab = III_rqselect(&rq, exp);
 	}
 
 	++expptr;
@@ -1062,16 +1233,11 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	  value += MASK(bitcache, cachesz, linbits);
 	  cachesz -= linbits;
 
-	  requantized = III_requantize(value, exp);
+	  requantized = III_rqlookup(rqtab, value);
 	  goto x_final;
 
 	default:
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = III_rqlookup(rqtab, value);
 
 	x_final:
 	  xrptr[0] = MASK1BIT(bitcache, cachesz--) ?
@@ -1097,16 +1263,11 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	  value += MASK(bitcache, cachesz, linbits);
 	  cachesz -= linbits;
 
-	  requantized = III_requantize(value, exp);
+	  requantized = III_rqlookup(rqtab, value);
 	  goto y_final;
 
 	default:
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = III_rqlookup(rqtab, value);
 
 	y_final:
 	  xrptr[1] = MASK1BIT(bitcache, cachesz--) ?
@@ -1121,12 +1282,7 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	if (value == 0)
 	  xrptr[0] = 0;
 	else {
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = III_rqlookup(rqtab, value);
 
 	  xrptr[0] = MASK1BIT(bitcache, cachesz--) ?
 	    -requantized : requantized;
@@ -1139,12 +1295,7 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	if (value == 0)
 	  xrptr[1] = 0;
 	else {
-	  if (reqhits & (1 << value))
-	    requantized = reqcache[value];
-	  else {
-	    reqhits |= (1 << value);
-	    requantized = reqcache[value] = III_requantize(value, exp);
-	  }
+	  requantized = III_rqlookup(rqtab, value);
 
 	  xrptr[1] = MASK1BIT(bitcache, cachesz--) ?
 	    -requantized : requantized;
@@ -1163,9 +1314,9 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
     union huffquad const *table;
     register mad_fixed_t requantized;
 
-    table = mad_huff_quad_table[channel->flags & count1table_select];
+    table = mad_huff_quad[channel->flags & count1table_select];
 
-    requantized = III_requantize(1, exp);
+    requantized = III_rqlookup(rqtab, 1);
 
     while (cachesz + bits_left > 0 && xrptr <= &xr[572]) {
       union huffquad const *quad;
@@ -1194,8 +1345,9 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	sfbound += *sfbwidth++;
 
 	if (exp != *expptr) {
-	  exp = *expptr;
-	  requantized = III_requantize(1, exp);
+	  exp   = *expptr;
+	  rqtab = III_rqselect(&rq, exp);
+	  requantized = III_rqlookup(rqtab, 1);
 	}
 
 	++expptr;
@@ -1217,8 +1369,9 @@ enum mad_error III_huffdecode(struct mad_bitptr *ptr, mad_fixed_t xr[576],
 	sfbound += *sfbwidth++;
 
 	if (exp != *expptr) {
-	  exp = *expptr;
-	  requantized = III_requantize(1, exp);
+	  exp   = *expptr;
+	  rqtab = III_rqselect(&rq, exp);
+	  requantized = III_rqlookup(rqtab, 1);
 	}
 
 	++expptr;
@@ -2063,6 +2216,8 @@ static
 void III_imdct_l(mad_fixed_t const X[18], mad_fixed_t z[36],
 		 unsigned int block_type)
 {
+  mad_fixed_t const *win_l = III_tables.window_l;
+  mad_fixed_t const *win_s = III_tables.window_s;
   unsigned int i;
 
   /* IMDCT */
@@ -2077,14 +2232,14 @@ void III_imdct_l(mad_fixed_t const X[18], mad_fixed_t z[36],
     {
       register mad_fixed_t tmp1, tmp2;
 
-      tmp1 = window_l[0];
-      tmp2 = window_l[1];
+      tmp1 = win_l[0];
+      tmp2 = win_l[1];
 
       for (i = 0; i < 34; i += 2) {
 	z[i + 0] = mad_f_mul(z[i + 0], tmp1);
-	tmp1 = window_l[i + 2];
+	tmp1 = win_l[i + 2];
 	z[i + 1] = mad_f_mul(z[i + 1], tmp2);
-	tmp2 = window_l[i + 3];
+	tmp2 = win_l[i + 3];
       }
 
       z[34] = mad_f_mul(z[34], tmp1);
@@ -2095,47 +2250,47 @@ void III_imdct_l(mad_fixed_t const X[18], mad_fixed_t z[36],
       register mad_fixed_t tmp1, tmp2;
 
       tmp1 = z[0];
-      tmp2 = window_l[0];
+      tmp2 = win_l[0];
 
       for (i = 0; i < 35; ++i) {
 	z[i] = mad_f_mul(tmp1, tmp2);
 	tmp1 = z[i + 1];
-	tmp2 = window_l[i + 1];
+	tmp2 = win_l[i + 1];
       }
 
       z[35] = mad_f_mul(tmp1, tmp2);
     }
 # elif 1
     for (i = 0; i < 36; i += 4) {
-      z[i + 0] = mad_f_mul(z[i + 0], window_l[i + 0]);
-      z[i + 1] = mad_f_mul(z[i + 1], window_l[i + 1]);
-      z[i + 2] = mad_f_mul(z[i + 2], window_l[i + 2]);
-      z[i + 3] = mad_f_mul(z[i + 3], window_l[i + 3]);
+      z[i + 0] = mad_f_mul(z[i + 0], win_l[i + 0]);
+      z[i + 1] = mad_f_mul(z[i + 1], win_l[i + 1]);
+      z[i + 2] = mad_f_mul(z[i + 2], win_l[i + 2]);
+      z[i + 3] = mad_f_mul(z[i + 3], win_l[i + 3]);
     }
 # else
-    for (i =  0; i < 36; ++i) z[i] = mad_f_mul(z[i], window_l[i]);
+    for (i =  0; i < 36; ++i) z[i] = mad_f_mul(z[i], win_l[i]);
 # endif
     break;
 
   case 1:  /* start block */
     for (i =  0; i < 18; i += 3) {
-      z[i + 0] = mad_f_mul(z[i + 0], window_l[i + 0]);
-      z[i + 1] = mad_f_mul(z[i + 1], window_l[i + 1]);
-      z[i + 2] = mad_f_mul(z[i + 2], window_l[i + 2]);
+      z[i + 0] = mad_f_mul(z[i + 0], win_l[i + 0]);
+      z[i + 1] = mad_f_mul(z[i + 1], win_l[i + 1]);
+      z[i + 2] = mad_f_mul(z[i + 2], win_l[i + 2]);
     }
     /*  (i = 18; i < 24; ++i) z[i] unchanged */
-    for (i = 24; i < 30; ++i) z[i] = mad_f_mul(z[i], window_s[i - 18]);
+    for (i = 24; i < 30; ++i) z[i] = mad_f_mul(z[i], win_s[i - 18]);
     for (i = 30; i < 36; ++i) z[i] = 0;
     break;
 
   case 3:  /* stop block */
     for (i =  0; i <  6; ++i) z[i] = 0;
-    for (i =  6; i < 12; ++i) z[i] = mad_f_mul(z[i], window_s[i - 6]);
+    for (i =  6; i < 12; ++i) z[i] = mad_f_mul(z[i], win_s[i - 6]);
     /*  (i = 12; i < 18; ++i) z[i] unchanged */
     for (i = 18; i < 36; i += 3) {
-      z[i + 0] = mad_f_mul(z[i + 0], window_l[i + 0]);
-      z[i + 1] = mad_f_mul(z[i + 1], window_l[i + 1]);
-      z[i + 2] = mad_f_mul(z[i + 2], window_l[i + 2]);
+      z[i + 0] = mad_f_mul(z[i + 0], win_l[i + 0]);
+      z[i + 1] = mad_f_mul(z[i + 1], win_l[i + 1]);
+      z[i + 2] = mad_f_mul(z[i + 2], win_l[i + 2]);
     }
     break;
   }
@@ -2162,7 +2317,7 @@ void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
   for (w = 0; w < 3; ++w) {
     register mad_fixed_t const (*s)[6];
 
-    s = imdct_s;
+    s = III_tables.imdct_s;
 
     for (i = 0; i < 3; ++i) {
       MAD_F_ML0(hi, lo, X[0], (*s)[0]);
@@ -2197,7 +2352,7 @@ void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
   /* windowing, overlapping and concatenation */
 
   yptr = &y[0];
-  wptr = &window_s[0];
+  wptr = III_tables.window_s;
 
   for (i = 0; i < 6; ++i) {
     z[i +  0] = 0;
@@ -2344,172 +2499,356 @@ void III_freqinver(mad_fixed_t sample[18][32], unsigned int sb)
 }
 
 /*
- * NAME:	III_decode()
- * DESCRIPTION:	decode frame main_data
+ * NAME:	III_sfreqi()
+ * DESCRIPTION:	index of the header's sample rate in sfbwidth_table
  */
 static
-enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
-			  struct sideinfo *si, unsigned int nch)
+unsigned int III_sfreqi(struct mad_header const *header)
 {
-  struct mad_header *header = &frame->header;
-  unsigned int sfreqi, ngr, gr;
+  unsigned int sfreq, sfreqi;
 
-  {
-    unsigned int sfreq;
+  sfreq = header->samplerate;
+  if (header->flags & MAD_FLAG_MPEG_2_5_EXT)
+    sfreq *= 2;
 
-    sfreq = header->samplerate;
-    if (header->flags & MAD_FLAG_MPEG_2_5_EXT)
-      sfreq *= 2;
+  /* 48000 => 0, 44100 => 1, 32000 => 2,
+     24000 => 3, 22050 => 4, 16000 => 5 */
+  sfreqi = ((sfreq >>  7) & 0x000f) +
+           ((sfreq >> 15) & 0x0001) - 8;
 
-    /* 48000 => 0, 44100 => 1, 32000 => 2,
-       24000 => 3, 22050 => 4, 16000 => 5 */
-    sfreqi = ((sfreq >>  7) & 0x000f) +
-             ((sfreq >> 15) & 0x0001) - 8;
+  if (header->flags & MAD_FLAG_MPEG_2_5_EXT)
+    sfreqi += 3;
 
-    if (header->flags & MAD_FLAG_MPEG_2_5_EXT)
-      sfreqi += 3;
+  return sfreqi;
+}
+
+/*
+ * NAME:	III_sfbwidth()
+ * DESCRIPTION:	scalefactor band widths for a granule channel
+ */
+static inline
+unsigned char const *III_sfbwidth(unsigned int sfreqi,
+				  struct channel const *channel)
+{
+  if (channel->block_type == 2) {
+    return (channel->flags & mixed_block_flag) ?
+      sfbwidth_table[sfreqi].m : sfbwidth_table[sfreqi].s;
   }
 
-  /* scalefactors, Huffman decoding, requantization */
+  return sfbwidth_table[sfreqi].l;
+}
 
-  ngr = (header->flags & MAD_FLAG_LSF_EXT) ? 1 : 2;
+/*
+ * NAME:	III_spectrum()
+ * DESCRIPTION:	scalefactors, Huffman decoding and requantization of one
+ *		granule's main_data into xr[]
+ */
+static
+enum mad_error III_spectrum(struct mad_bitptr *ptr,
+			    struct mad_header *header,
+			    struct sideinfo *si, unsigned int nch,
+			    unsigned int gr, mad_fixed_t xr[2][576],
+			    struct mad_stats *stats)
+{
+  unsigned int sfreqi, ch;
+  enum mad_error error;
 
-  for (gr = 0; gr < ngr; ++gr) {
-    struct granule *granule = &si->gr[gr];
-    unsigned char const *sfbwidth[2];
-    mad_fixed_t xr[2][576];
-    unsigned int ch;
-    enum mad_error error;
+  sfreqi = III_sfreqi(header);
 
-    for (ch = 0; ch < nch; ++ch) {
-      struct channel *channel = &granule->ch[ch];
-      unsigned int part2_length;
+  for (ch = 0; ch < nch; ++ch) {
+    struct channel *channel = &si->gr[gr].ch[ch];
+    unsigned int part2_length;
+    MAD_STATS_START(t);
 
-      sfbwidth[ch] = sfbwidth_table[sfreqi].l;
-      if (channel->block_type == 2) {
-	sfbwidth[ch] = (channel->flags & mixed_block_flag) ?
-	  sfbwidth_table[sfreqi].m : sfbwidth_table[sfreqi].s;
-      }
+    if (header->flags & MAD_FLAG_LSF_EXT) {
+      part2_length = III_scalefactors_lsf(ptr, channel,
+					  ch == 0 ? 0 : &si->gr[1].ch[1],
+					  header->mode_extension);
+    }
+    else {
+      part2_length = III_scalefactors(ptr, channel, &si->gr[0].ch[ch],
+				      gr == 0 ? 0 : si->scfsi[ch]);
+    }
 
-      if (header->flags & MAD_FLAG_LSF_EXT) {
-	part2_length = III_scalefactors_lsf(ptr, channel,
-					    ch == 0 ? 0 : &si->gr[1].ch[1],
-					    header->mode_extension);
-      }
-      else {
-	part2_length = III_scalefactors(ptr, channel, &si->gr[0].ch[ch],
-					gr == 0 ? 0 : si->scfsi[ch]);
-      }
+    error = III_huffdecode(ptr, xr[ch], channel,
+			   III_sfbwidth(sfreqi, channel), part2_length);
+    MAD_STATS_STOP(stats, MAD_STAGE_HUFFMAN, t);
+    if (error)
+      return error;
+  }
 
-      error = III_huffdecode(ptr, xr[ch], channel, sfbwidth[ch], part2_length);
-      if (error)
-	return error;
-    }
+  /* joint stereo processing */
 
-    /* joint stereo processing */
+  if (header->mode == MAD_MODE_JOINT_STEREO && header->mode_extension) {
+    MAD_STATS_START(t);
+    error = III_stereo(xr, &si->gr[gr], header,
+		       III_sfbwidth(sfreqi, &si->gr[gr].ch[0]));
+    MAD_STATS_STOP(stats, MAD_STAGE_STEREO, t);
+    if (error)
+      return error;
+  }
 
-    if (header->mode == MAD_MODE_JOINT_STEREO && header->mode_extension) {
-      error = III_stereo(xr, granule, header, sfbwidth[0]);
-      if (error)
-	return error;
-    }
+  return MAD_ERROR_NONE;
+}
 
-    /* reordering, alias reduction, IMDCT, overlap-add, frequency inversion */
+/*
+ * NAME:	III_output()
+ * DESCRIPTION:	reordering, alias reduction, IMDCT, overlap-add and
+ *		frequency inversion of one granule's xr[] into the frame's
+ *		subband samples, for channels ch0 up to (not including) ch1
+ */
+static
+void III_output(struct mad_frame *frame, struct sideinfo const *si,
+		unsigned int gr, mad_fixed_t xr[2][576],
+		unsigned int ch0, unsigned int ch1)
+{
+  struct granule const *granule = &si->gr[gr];
+  unsigned int sfreqi, ch, limit;
 
-    for (ch = 0; ch < nch; ++ch) {
-      struct channel const *channel = &granule->ch[ch];
-      mad_fixed_t (*sample)[32] = &frame->sbsample[ch][18 * gr];
-      unsigned int sb, l, i, sblimit;
-      mad_fixed_t output[36];
+  sfreqi = III_sfreqi(&frame->header);
+
+  /* subbands the synthesis will use, see frame->sblimit */
+
+  limit = 32 >> MAD_RATE_SHIFT(frame->options);
+  if (limit > frame->sblimit)
+    limit = frame->sblimit;
+
+  for (ch = ch0; ch < ch1; ++ch) {
+    struct channel const *channel = &granule->ch[ch];
+    unsigned char const *sfbwidth = III_sfbwidth(sfreqi, channel);
+    mad_fixed_t (*sample)[32] = &frame->sbsample[ch][18 * gr];
+    unsigned int sb, l, i, sblimit;
+    mad_fixed_t output[36];
 
-      if (channel->block_type == 2) {
-	III_reorder(xr[ch], channel, sfbwidth[ch]);
+    if (channel->block_type == 2) {
+      III_reorder(xr[ch], channel, sfbwidth);
 
 # if !defined(OPT_STRICT)
-	/*
-	 * According to ISO/IEC 11172-3, "Alias reduction is not applied for
-	 * granules with block_type == 2 (short block)." However, other
-	 * sources suggest alias reduction should indeed be performed on the
-	 * lower two subbands of mixed blocks. Most other implementations do
-	 * this, so by default we will too.
-	 */
-	if (channel->flags & mixed_block_flag)
-	  III_aliasreduce(xr[ch], 36);
+      /*
+       * According to ISO/IEC 11172-3, "Alias reduction is not applied for
+       * granules with block_type == 2 (short block)." However, other
+       * sources suggest alias reduction should indeed be performed on the
+       * lower two subbands of mixed blocks. Most other implementations do
+       * this, so by default we will too.
+       */
+      if (channel->flags & mixed_block_flag)
+	III_aliasreduce(xr[ch], 36);
 # endif
-      }
-      else
-	III_aliasreduce(xr[ch], 576);
+    }
+    else
+      III_aliasreduce(xr[ch], limit < 32 ? 18 * (limit + 1) : 576);
 
-      l = 0;
+    l = 0;
 
-      /* subbands 0-1 */
+    /* subbands 0-1 */
 
-      if (channel->block_type != 2 || (channel->flags & mixed_block_flag)) {
-	unsigned int block_type;
+    if (channel->block_type != 2 || (channel->flags & mixed_block_flag)) {
+      unsigned int block_type;
 
-	block_type = channel->block_type;
-	if (channel->flags & mixed_block_flag)
-	  block_type = 0;
+      block_type = channel->block_type;
+      if (channel->flags & mixed_block_flag)
+	block_type = 0;
 
-	/* long blocks */
-	for (sb = 0; sb < 2; ++sb, l += 18) {
-	  III_imdct_l(&xr[ch][l], output, block_type);
-	  III_overlap(output, frame->overlap[ch][sb], sample, sb);
-	}
+      /* long blocks */
+      for (sb = 0; sb < 2; ++sb, l += 18) {
+	III_imdct_l(&xr[ch][l], output, block_type);
+	III_overlap(output, frame->overlap[ch][sb], sample, sb);
       }
-      else {
-	/* short blocks */
-	for (sb = 0; sb < 2; ++sb, l += 18) {
-	  III_imdct_s(&xr[ch][l], output);
-	  III_overlap(output, frame->overlap[ch][sb], sample, sb);
-	}
+    }
+    else {
+      /* short blocks */
+      for (sb = 0; sb < 2; ++sb, l += 18) {
+	III_imdct_s(&xr[ch][l], output);
+	III_overlap(output, frame->overlap[ch][sb], sample, sb);
       }
+    }
 
-      III_freqinver(sample, 1);
+    III_freqinver(sample, 1);
 
-      /* (nonzero) subbands 2-31 */
+    /* (nonzero) subbands 2-31 */
 
-      i = 576;
-      while (i > 36 && xr[ch][i - 1] == 0)
-	--i;
+    i = 576;
+    while (i > 36 && xr[ch][i - 1] == 0)
+      --i;
 
-      sblimit = 32 - (576 - i) / 18;
+    sblimit = 32 - (576 - i) / 18;
+    if (sblimit > limit)
+      sblimit = limit;
 
-      if (channel->block_type != 2) {
-	/* long blocks */
-	for (sb = 2; sb < sblimit; ++sb, l += 18) {
-	  III_imdct_l(&xr[ch][l], output, channel->block_type);
-	  III_overlap(output, frame->overlap[ch][sb], sample, sb);
+    if (channel->block_type != 2) {
+      /* long blocks */
+      for (sb = 2; sb < sblimit; ++sb, l += 18) {
+	III_imdct_l(&xr[ch][l], output, channel->block_type);
+	III_overlap(output, frame->overlap[ch][sb], sample, sb);
 
-	  if (sb & 1)
-	    III_freqinver(sample, sb);
-	}
+	if (sb & 1)
+	  III_freqinver(sample, sb);
       }
-      else {
-	/* short blocks */
-	for (sb = 2; sb < sblimit; ++sb, l += 18) {
-	  III_imdct_s(&xr[ch][l], output);
-	  III_overlap(output, frame->overlap[ch][sb], sample, sb);
+    }
+    else {
+      /* short blocks */
+      for (sb = 2; sb < sblimit; ++sb, l += 18) {
+	III_imdct_s(&xr[ch][l], output);
+	III_overlap(output, frame->overlap[ch][sb], sample, sb);
 
-	  if (sb & 1)
-	    III_freqinver(sample, sb);
-	}
+	if (sb & 1)
+	  III_freqinver(sample, sb);
       }
+    }
 
-      /* remaining (zero) subbands */
+    /* remaining (zero) subbands */
 
-      for (sb = sblimit; sb < 32; ++sb) {
-	III_overlap_z(frame->overlap[ch][sb], sample, sb);
+    for (sb = sblimit; sb < 32; ++sb) {
+      III_overlap_z(frame->overlap[ch][sb], sample, sb);
 
-	if (sb & 1)
-	  III_freqinver(sample, sb);
-      }
+      if (sb & 1)
+	III_freqinver(sample, sb);
+    }
+  }
+}
+
+/*
+ * Two stage decoding: with frame->stage set, mad_layer_III() stops after
+ * III_spectrum() and leaves what III_output() needs in the stage instead
+ * of touching frame->sbsample and frame->overlap, so the second half can
+ * run later, on another core, through mad_layer_III_stage2().
+ */
+struct III_stage {
+  struct sideinfo si;
+  unsigned int nch;
+  unsigned int ngr;			/* granules decoded into xr[] */
+  mad_fixed_t xr[2][2][576];
+};
+
+/*
+ * NAME:	III_decode()
+ * DESCRIPTION:	decode frame main_data
+ */
+static
+enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
+			  struct sideinfo *si, unsigned int nch)
+{
+  struct III_stage *stage = frame->stage;
+  unsigned int ngr, gr;
+  enum mad_error error;
+
+  ngr = (frame->header.flags & MAD_FLAG_LSF_EXT) ? 1 : 2;
+
+  if (stage) {
+    stage->si  = *si;
+    stage->nch = nch;
+
+    for (gr = 0; gr < ngr; ++gr) {
+      error = III_spectrum(ptr, &frame->header, &stage->si, nch, gr,
+			   stage->xr[gr], frame->stats);
+      if (error)
+	return error;
+
+      ++stage->ngr;
+    }
+
+    return MAD_ERROR_NONE;
+  }
+
+  for (gr = 0; gr < ngr; ++gr) {
+    mad_fixed_t xr[2][576];
+
+    error = III_spectrum(ptr, &frame->header, si, nch, gr, xr,
+			 frame->stats);
+    if (error)
+      return error;
+
+    {
+      MAD_STATS_START(t);
+      III_output(frame, si, gr, xr, 0, nch);
+      MAD_STATS_STOP(frame->stats, MAD_STAGE_IMDCT, t);
     }
   }
 
   return MAD_ERROR_NONE;
 }
 
+/*
+ * NAME:	layer->III_stage_size()
+ * DESCRIPTION:	return the bytes a frame->stage needs
+ */
+unsigned long mad_layer_III_stage_size(void)
+{
+  return sizeof(struct III_stage);
+}
+
+/*
+ * NAME:	layer->III_stage2()
+ * DESCRIPTION:	finish what mad_layer_III() decoded into a stage, even if
+ *		it failed part way; frame->header must be the frame's own
+ */
+void mad_layer_III_stage2(struct mad_frame *frame, void *stage_in)
+{
+  struct III_stage *stage = stage_in;
+  unsigned int gr;
+
+  for (gr = 0; gr < stage->ngr; ++gr)
+    III_output(frame, &stage->si, gr, stage->xr[gr], 0, stage->nch);
+}
+
+/*
+ * NAME:	layer->III_stage2_channel()
+ * DESCRIPTION:	finish one channel of a stage; the channels share nothing,
+ *		so they can be finished at the same time on different cores
+ */
+void mad_layer_III_stage2_channel(struct mad_frame *frame, void *stage_in,
+				  unsigned int ch)
+{
+  struct III_stage *stage = stage_in;
+  unsigned int gr;
+
+  if (ch >= stage->nch)
+    return;
+
+  for (gr = 0; gr < stage->ngr; ++gr)
+    III_output(frame, &stage->si, gr, stage->xr[gr], ch, ch + 1);
+}
+
+/*
+ * NAME:	layer->III_pin()
+ * DESCRIPTION:	copy the IMDCT tables into a RAM block (or restore the
+ *		built-in tables if block is null); return the bytes needed
+ */
+unsigned long mad_layer_III_pin(unsigned char *block)
+{
+  unsigned long size = 0;
+
+# if !defined(ASO_IMDCT)
+  size += sizeof(window_l);
+# endif
+  size += sizeof(window_s) + sizeof(imdct_s);
+
+  if (block == 0) {
+# if !defined(ASO_IMDCT)
+    III_tables.window_l = window_l;
+# endif
+    III_tables.window_s = window_s;
+    III_tables.imdct_s  = imdct_s;
+
+    return size;
+  }
+
+# if !defined(ASO_IMDCT)
+  memcpy(block, window_l, sizeof(window_l));
+  III_tables.window_l = (mad_fixed_t const *) block;
+  block += sizeof(window_l);
+# endif
+
+  memcpy(block, window_s, sizeof(window_s));
+  III_tables.window_s = (mad_fixed_t const *) block;
+  block += sizeof(window_s);
+
+  memcpy(block, imdct_s, sizeof(imdct_s));
+  III_tables.imdct_s = (mad_fixed_t const (*)[6]) block;
+
+  return size;
+}
+
 /*
  * NAME:	layer->III()
  * DESCRIPTION:	decode a single Layer III frame
@@ -2525,6 +2864,11 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
   enum mad_error error;
   int result = 0;
 
+  /* nothing staged for the second half yet */
+
+  if (frame->stage)
+    ((struct III_stage *) frame->stage)->ngr = 0;
+
   /* allocate Layer III dynamic structures */
 
   nch = MAD_NCHANNELS(header);
@@ -2555,8 +2899,12 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
 
   /* decode frame side information */
 
-  error = III_sideinfo(&stream->ptr, nch, header->flags & MAD_FLAG_LSF_EXT,
-		       &si, &data_bitlen, &priv_bitlen);
+  {
+    MAD_STATS_START(t);
+    error = III_sideinfo(&stream->ptr, nch, header->flags & MAD_FLAG_LSF_EXT,
+			 &si, &data_bitlen, &priv_bitlen);
+    MAD_STATS_STOP(frame->stats, MAD_STAGE_SIDEINFO, t);
+  }
   if (error && result == 0) {
     stream->error = error;
     result = -1;
@@ -2622,6 +2970,12 @@ int mad_layer_III(struct mad_stream *stream, struct mad_frame *frame)
 	       frame_used = md_len - si.main_data_begin);
 	stream->md_len += frame_used;
       }
+
+      /* a corrupt part2_3_length can make the Huffman decoder read past
+	 the main data; have it read zeros rather than what earlier frames
+	 left in the buffer, so the result doesn't depend on the history */
+      memset(stream->main_data + stream->md_len, 0,
+	     MAD_BUFFER_MDLEN - stream->md_len);
     }
   }
 
@@ -26,5 +26,10 @@
 # include "frame.h"
 
 int mad_layer_III(struct mad_stream *, struct mad_frame *);
+unsigned long mad_layer_III_pin(unsigned char *);
+
+unsigned long mad_layer_III_stage_size(void);
+void mad_layer_III_stage2(struct mad_frame *, void *);
+void mad_layer_III_stage2_channel(struct mad_frame *, void *, unsigned int);
 
 # endif
@@ -1,4 +1,6 @@
-# define FPM_INTEL
+# if !defined(FPM_INTEL)
+#  define FPM_INTEL
+# endif
 
 # define SIZEOF_INT 4
 # define SIZEOF_LONG 4
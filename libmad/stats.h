@@ -0,0 +1,139 @@
+/*
+ * libmad - MPEG audio decoder library
+ *
+ * Per-stage timing of the decoder, compiled in with -DMAD_STATS.
+ *
+ * A struct mad_stats collects, for each stage, the total ticks spent in
+ * it, the longest single call and the number of calls. libmad times the
+ * Layer III stages it runs through frame->stats, the caller times the
+ * rest (headers, synthesis, its own I/O) with the same macros. Without
+ * MAD_STATS the macros compile to nothing.
+ */
+
+# ifndef LIBMAD_STATS_H
+# define LIBMAD_STATS_H
+
+# include <stdint.h>
+
+enum mad_stage {
+  MAD_STAGE_HEADER,			/* mad_header_decode() */
+  MAD_STAGE_SIDEINFO,			/* III_sideinfo() */
+  MAD_STAGE_HUFFMAN,			/* III_huffdecode(), with scalefactors */
+  MAD_STAGE_STEREO,			/* III_stereo() */
+  MAD_STAGE_IMDCT,			/* reorder, alias, IMDCT, overlap */
+  MAD_STAGE_SYNTH,			/* mad_synth_frame() */
+  MAD_STAGE_INPUT,			/* the caller's input */
+  MAD_STAGE_OUTPUT,			/* the caller's output */
+  MAD_STAGE_COUNT
+};
+
+struct mad_stats {
+  uint64_t total[MAD_STAGE_COUNT];	/* ticks spent in each stage */
+  uint32_t max[MAD_STAGE_COUNT];	/* longest single call */
+  uint32_t count[MAD_STAGE_COUNT];	/* calls */
+};
+
+/*
+ * Ticks come from the cheapest counter the target has: the CPU cycle
+ * counter on x86, Xtensa (ESP32) and ARMv7-M/ARMv8-M (the DWT CYCCNT,
+ * which mad_ticks_init() switches on), the generic timer's virtual count
+ * on AArch64, and SysTick on ARMv6-M (the RP2040), which has no cycle
+ * counter; otherwise nothing. mad_ticks_since(t) is the ticks from t to
+ * now, allowing for counters narrower than 32 bits.
+ */
+# if defined(__x86_64__) || defined(__i386__)
+#  define MAD_TICKS_UNIT	"cycles"
+static inline uint32_t mad_ticks(void)
+{
+  return (uint32_t) __builtin_ia32_rdtsc();
+}
+#  define mad_ticks_init()	/* nothing */
+# elif defined(__XTENSA__)
+#  define MAD_TICKS_UNIT	"cycles"
+static inline uint32_t mad_ticks(void)
+{
+  uint32_t ccount;
+  __asm__ __volatile__ ("rsr %0, ccount" : "=a" (ccount));
+  return ccount;
+}
+#  define mad_ticks_init()	/* nothing */
+# elif defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) ||  \
+       defined(__ARM_ARCH_8M_MAIN__)
+#  define MAD_TICKS_UNIT	"cycles"
+#  define MAD_DEMCR		(*(volatile uint32_t *) 0xe000edfc)
+#  define MAD_DWT_CTRL		(*(volatile uint32_t *) 0xe0001000)
+#  define MAD_DWT_CYCCNT	(*(volatile uint32_t *) 0xe0001004)
+static inline uint32_t mad_ticks(void)
+{
+  return MAD_DWT_CYCCNT;
+}
+static inline void mad_ticks_init(void)
+{
+  MAD_DEMCR    |= 1UL << 24;		/* TRCENA */
+  MAD_DWT_CTRL |= 1UL;			/* CYCCNTENA */
+}
+# elif defined(__aarch64__)
+#  define MAD_TICKS_UNIT	"cntvct"
+static inline uint32_t mad_ticks(void)
+{
+  uint64_t cntvct;
+  __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (cntvct));
+  return (uint32_t) cntvct;
+}
+#  define mad_ticks_init()	/* nothing */
+# elif defined(__ARM_ARCH_6M__)
+/*
+ * SysTick counts processor cycles down from its reload value, 24 bits at
+ * most. mad_ticks_init() starts it free running over all 24 bits, without
+ * its interrupt, unless the port already runs it, in which case it has to
+ * be doing the same for the ticks to mean anything. Calls are timed up to
+ * 2^24 cycles, 134 ms at 125 MHz.
+ */
+#  define MAD_TICKS_UNIT	"cycles"
+#  define MAD_SYST_CSR		(*(volatile uint32_t *) 0xe000e010)
+#  define MAD_SYST_RVR		(*(volatile uint32_t *) 0xe000e014)
+#  define MAD_SYST_CVR		(*(volatile uint32_t *) 0xe000e018)
+#  define MAD_TICKS_MASK	0x00ffffffUL
+static inline uint32_t mad_ticks(void)
+{
+  return MAD_TICKS_MASK - MAD_SYST_CVR;
+}
+static inline void mad_ticks_init(void)
+{
+  if (!(MAD_SYST_CSR & 1UL)) {
+    MAD_SYST_RVR = MAD_TICKS_MASK;
+    MAD_SYST_CVR = 0;
+    MAD_SYST_CSR = (1UL << 2) | 1UL;	/* CLKSOURCE processor, ENABLE */
+  }
+}
+# else
+#  define MAD_TICKS_UNIT	"none"
+#  define mad_ticks()		0
+#  define mad_ticks_init()	/* nothing */
+# endif
+
+# if defined(MAD_TICKS_MASK)
+#  define mad_ticks_since(t)	((mad_ticks() - (t)) & MAD_TICKS_MASK)
+# else
+#  define mad_ticks_since(t)	(mad_ticks() - (t))
+# endif
+
+static inline void mad_stats_add(struct mad_stats *stats,
+				 enum mad_stage stage, uint32_t ticks)
+{
+  stats->total[stage] += ticks;
+  if (ticks > stats->max[stage])
+    stats->max[stage] = ticks;
+  ++stats->count[stage];
+}
+
+# if defined(MAD_STATS)
+#  define MAD_STATS_START(t)		uint32_t t = mad_ticks()
+#  define MAD_STATS_STOP(stats, stage, t)  \
+  do { if (stats) mad_stats_add((stats), (stage), mad_ticks_since(t)); } while (0)
+# else
+#  define MAD_STATS_START(t)		/* nothing */
+#  define MAD_STATS_STOP(stats, stage, t)  /* nothing */
+# endif
+
+# endif
@@ -44,17 +44,30 @@ void mad_stream_init(struct mad_stream *stream, unsigned char *buffer)
 
   stream->this_frame = buffer;
   stream->next_frame = buffer;
+  stream->need       = 0;
 
   mad_bit_init(&stream->ptr, 0);
   mad_bit_init(&stream->anc_ptr, 0);
   stream->anc_bitlen = 0;
 
+  stream->main_data  = 0;
   stream->md_len     = 0;
 
   stream->options    = 0;
   stream->error      = MAD_ERROR_NONE;
 }
 
+/*
+ * NAME:	stream->attach()
+ * DESCRIPTION:	give the stream caller-owned Layer III main_data storage
+ *		(MAD_BUFFER_MDLEN bytes, or null for Layer I/II only)
+ */
+void mad_stream_attach(struct mad_stream *stream, unsigned char *main_data)
+{
+  stream->main_data = main_data;
+  stream->md_len    = 0;
+}
+
 /*
  * NAME:	stream->finish()
  * DESCRIPTION:	deallocate any dynamic memory associated with stream
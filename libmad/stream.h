@@ -68,14 +68,16 @@ struct mad_stream {
 
   unsigned char const *this_frame;	/* start of current frame */
   unsigned char const *next_frame;	/* start of next frame */
+  unsigned int need;			/* bytes needed from next_frame */
+					/* after MAD_ERROR_BUFLEN */
 
   struct mad_bitptr ptr;		/* current processing bit pointer */
 
   struct mad_bitptr anc_ptr;		/* ancillary bits pointer */
   unsigned int anc_bitlen;		/* number of ancillary bits */
 
-  unsigned char main_data[MAD_BUFFER_MDLEN];
-					/* Layer III main_data() */
+  unsigned char *main_data;		/* Layer III main_data() */
+					/* (MAD_BUFFER_MDLEN bytes) */
   unsigned int md_len;			/* bytes in main_data */
 
   int options;				/* decoding options (see below) */
@@ -83,16 +85,26 @@ struct mad_stream {
 };
 
 enum {
-  MAD_OPTION_IGNORECRC      = 0x0001,	/* ignore CRC errors */
-  MAD_OPTION_HALFSAMPLERATE = 0x0002	/* generate PCM at 1/2 sample rate */
+  MAD_OPTION_IGNORECRC         = 0x0001,	/* ignore CRC errors */
+  MAD_OPTION_HALFSAMPLERATE    = 0x0002,	/* generate PCM at 1/2 sample rate */
+  MAD_OPTION_SSO               = 0x0004,	/* faster, less accurate synthesis */
+  MAD_OPTION_QUARTERSAMPLERATE = 0x0008,	/* generate PCM at 1/4 sample rate */
+  MAD_OPTION_EIGHTHSAMPLERATE  = 0x000a,	/* generate PCM at 1/8 sample rate */
 # if 0  /* not yet implemented */
-  MAD_OPTION_LEFTCHANNEL    = 0x0010,	/* decode left channel only */
-  MAD_OPTION_RIGHTCHANNEL   = 0x0020,	/* decode right channel only */
-  MAD_OPTION_SINGLECHANNEL  = 0x0030	/* combine channels */
+  MAD_OPTION_LEFTCHANNEL       = 0x0010,	/* decode left channel only */
+  MAD_OPTION_RIGHTCHANNEL      = 0x0020,	/* decode right channel only */
 # endif
+  MAD_OPTION_SINGLECHANNEL     = 0x0030	/* combine channels (into both) */
 };
 
+/* log2 of the PCM sample rate divisor the options ask for, 0 to 3 */
+
+# define MAD_RATE_SHIFT(options)  \
+    ((((options) & MAD_OPTION_HALFSAMPLERATE) ? 1 : 0) +  \
+     (((options) & MAD_OPTION_QUARTERSAMPLERATE) ? 2 : 0))
+
 void mad_stream_init(struct mad_stream *, unsigned char *buffer);
+void mad_stream_attach(struct mad_stream *, unsigned char *main_data);
 void mad_stream_finish(struct mad_stream *);
 void mad_stream_buffer(struct mad_stream *,	 unsigned char *, unsigned long);
 void mad_stream_skip(struct mad_stream *, unsigned long);
@@ -29,11 +29,13 @@ struct mad_pcm {
   unsigned int samplerate;		/* sampling frequency (Hz) */
   unsigned short channels;		/* number of channels */
   unsigned short length;		/* number of samples per channel */
-  signed short samples[2][1152];		/* PCM output samples [ch][sample] */
+  signed short (*samples)[1152];		/* PCM output samples [ch][sample] */
 };
 
 struct mad_synth {
-  mad_fixed_t filter[2][2][2][16][8];	/* polyphase filterbank outputs */
+  /* caller-owned storage, see mad_synth_attach() */
+  unsigned int nch;			/* channels of storage attached */
+  mad_fixed_t (*filter)[2][2][16][8];	/* polyphase filterbank outputs */
   					/* [ch][eo][peo][s][v] */
 
   unsigned int phase;			/* current processing phase */
@@ -59,11 +61,18 @@ enum {
 };
 
 void mad_synth_init(struct mad_synth *);
+void mad_synth_attach(struct mad_synth *, unsigned int,
+		      mad_fixed_t (*)[2][2][16][8], signed short (*)[1152]);
 
 # define mad_synth_finish(synth)  /* nothing */
 
 void mad_synth_mute(struct mad_synth *);
 
 void mad_synth_frame(struct mad_synth *, struct mad_frame const *);
+void mad_synth_channel(struct mad_synth *, struct mad_frame const *,
+		       unsigned int);
+void mad_synth_advance(struct mad_synth *, struct mad_frame const *);
+
+unsigned long mad_synth_pin(unsigned char *);
 
 # endif
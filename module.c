@@ -8,20 +8,205 @@
 // instantiated in global context so it's accessible everywhere
 mp_obj_full_type_t mp_type_libmad_decoder;
 
+// and for the frame views, libmad.PCM and libmad.Header
+mp_obj_full_type_t mp_type_libmad_pcm;
+mp_obj_full_type_t mp_type_libmad_header;
+
 // Implementation of libmad.Decoder
 
+// deadline=: percent of a frame's playing time its decoding may take before it counts as
+// a miss in realtime(), 0 to not time frames at all, which saves two time.ticks_us calls a
+// frame. That's the default, but for a governor, which has nothing to go on without it
+#define DEADLINE_MAX 1000
+#define DEADLINE_GOVERNOR 100
+
+static void check_deadline(mp_int_t deadline) {
+  if (deadline < 0 || deadline > DEADLINE_MAX) {
+    mp_raise_ValueError("deadline must be 0 to 1000 percent");
+  }
+}
+
+// options=: MAD_OPTION_* flags for every frame
+#define OPTIONS_ALL (MAD_OPTION_IGNORECRC | MAD_OPTION_HALFSAMPLERATE | MAD_OPTION_QUARTERSAMPLERATE | \
+                     MAD_OPTION_SSO | MAD_OPTION_SINGLECHANNEL)
+
+static void check_options(mp_int_t options) {
+  if (options & ~OPTIONS_ALL) {
+    mp_raise_ValueError("unknown option");
+  }
+}
+
+static void check_quality(mp_int_t quality) {
+  if (quality < DECODER_QUALITY_FULL || quality > DECODER_QUALITY_LOWEST) {
+    mp_raise_ValueError("unknown quality level");
+  }
+}
+
+// Frame views: get_pcm() and get_frame_header() hand out the same object for every frame,
+// updated in place, so an output callback that reads them allocates nothing in the steady
+// state. A view describes the frame being output and is only valid until the callback
+// returns, copy whatever has to outlive it.
+
+// PCM view: channels, samplerate, width and length (samples per channel) of the frame, and
+// left, right (None for mono) and interleaved, bytearrays of its 16-bit samples. They're
+// copies, not the synth's samples, which move when the state grows: each is copied on first
+// use in each frame into a buffer the view allocates the first time, and the bytearray over
+// it is only made again when the frame length changes. Writing into one changes nothing
+// but the copy.
+enum { PCM_LEFT, PCM_RIGHT, PCM_INTERLEAVED, PCM_VIEWS };
+
+typedef struct {
+  mp_obj_base_t base;
+  mp_obj_t decoder;
+  mp_obj_t views[PCM_VIEWS];          // MP_OBJ_NULL until first used
+  signed short *buffers[PCM_VIEWS];   // 1152, 1152 and 2 x 1152 samples for them
+  unsigned short lengths[PCM_VIEWS];  // the frame length each bytearray was made for
+  unsigned char stale;                // a bit for each view still holding an earlier frame
+} pcm_view_t;
+
+// Header view: the fields of the frame's header, layer, mode, mode_extension, emphasis,
+// bitrate, samplerate, crc_check, crc_target, flags and private_bits, plus duration_seconds
+// and duration_milliseconds, only worked out when they're read.
+typedef struct {
+  mp_obj_base_t base;
+  struct mad_header header;
+} header_view_t;
+
+static mp_obj_t pcm_view_new(mp_obj_t decoder) {
+  pcm_view_t *self = mp_obj_malloc(pcm_view_t, (mp_obj_type_t *)&mp_type_libmad_pcm);
+  self->decoder = decoder;
+  for (unsigned int i = 0; i < PCM_VIEWS; i++) {
+    self->views[i] = MP_OBJ_NULL;
+    self->buffers[i] = NULL;
+    self->lengths[i] = 0;
+  }
+  self->stale = (1 << PCM_VIEWS) - 1;
+  return MP_OBJ_FROM_PTR(self);
+}
+
+static struct mad_pcm *pcm_view_pcm(pcm_view_t *self) {
+  mp_obj_libmad_decoder_t *decoder = MP_OBJ_TO_PTR(self->decoder);
+  return &decoder->synth.pcm;
+}
+
+// the samples of one of the views, copied out of the synth if the frame is new to it.
+// Outside of run() the synth's samples may be gone, so it keeps what it has then
+static mp_obj_t pcm_view_samples(pcm_view_t *self, unsigned int which) {
+  mp_obj_libmad_decoder_t *decoder = MP_OBJ_TO_PTR(self->decoder);
+  struct mad_pcm *pcm = &decoder->synth.pcm;
+  unsigned int per = (which == PCM_INTERLEAVED) ? 2 : 1;
+
+  if (!(self->stale & (1 << which)) || !decoder->running || pcm->samples == NULL) {
+    return (self->views[which] != MP_OBJ_NULL) ? self->views[which] : mp_const_none;
+  }
+  if (self->buffers[which] == NULL) {
+    self->buffers[which] = m_malloc(per * 1152 * sizeof(self->buffers[which][0]));
+  }
+  if (self->views[which] == MP_OBJ_NULL || self->lengths[which] != pcm->length) {
+    self->views[which] = mp_obj_new_bytearray_by_ref(per * pcm->length * sizeof(self->buffers[which][0]),
+                                                     self->buffers[which]);
+    self->lengths[which] = pcm->length;
+  }
+
+  signed short *out = self->buffers[which];
+  if (which == PCM_INTERLEAVED) {
+    signed short const *left = pcm->samples[0], *right = pcm->samples[1];
+    for (unsigned int i = 0; i < pcm->length; i++) {
+      *out++ = left[i];
+      *out++ = right[i];
+    }
+  } else {
+    memcpy(out, pcm->samples[which], pcm->length * sizeof(out[0]));
+  }
+  self->stale &= ~(1 << which);
+  return self->views[which];
+}
+
+static void pcm_view_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+  pcm_view_t *self = MP_OBJ_TO_PTR(self_in);
+  struct mad_pcm *pcm = pcm_view_pcm(self);
+
+  if (dest[0] != MP_OBJ_NULL) {
+    return; // read-only
+  }
+  if (attr == MP_QSTR_channels) {
+    dest[0] = mp_obj_new_int(pcm->channels);
+  } else if (attr == MP_QSTR_samplerate) {
+    dest[0] = mp_obj_new_int(pcm->samplerate);
+  } else if (attr == MP_QSTR_width) {
+    dest[0] = mp_obj_new_int(sizeof(pcm->samples[0][0]));
+  } else if (attr == MP_QSTR_length) {
+    dest[0] = mp_obj_new_int(pcm->length);
+  } else if (attr == MP_QSTR_left) {
+    dest[0] = pcm_view_samples(self, PCM_LEFT);
+  } else if (attr == MP_QSTR_right) {
+    dest[0] = (pcm->channels > 1) ? pcm_view_samples(self, PCM_RIGHT) : mp_const_none;
+  } else if (attr == MP_QSTR_interleaved) {
+    // mono has nothing to interleave
+    dest[0] = pcm_view_samples(self, (pcm->channels > 1) ? PCM_INTERLEAVED : PCM_LEFT);
+  }
+}
+
+static mp_obj_t header_view_new(void) {
+  header_view_t *self = mp_obj_malloc(header_view_t, (mp_obj_type_t *)&mp_type_libmad_header);
+  mad_header_init(&self->header);
+  return MP_OBJ_FROM_PTR(self);
+}
+
+static void header_view_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+  header_view_t *self = MP_OBJ_TO_PTR(self_in);
+  struct mad_header *header = &self->header;
+
+  if (dest[0] != MP_OBJ_NULL) {
+    return; // read-only
+  }
+  if (attr == MP_QSTR_layer) {
+    dest[0] = mp_obj_new_int(header->layer);
+  } else if (attr == MP_QSTR_mode) {
+    dest[0] = mp_obj_new_int(header->mode);
+  } else if (attr == MP_QSTR_mode_extension) {
+    dest[0] = mp_obj_new_int(header->mode_extension);
+  } else if (attr == MP_QSTR_emphasis) {
+    dest[0] = mp_obj_new_int(header->emphasis);
+  } else if (attr == MP_QSTR_bitrate) {
+    dest[0] = mp_obj_new_int(header->bitrate);
+  } else if (attr == MP_QSTR_samplerate) {
+    dest[0] = mp_obj_new_int(header->samplerate);
+  } else if (attr == MP_QSTR_crc_check) {
+    dest[0] = mp_obj_new_int(header->crc_check);
+  } else if (attr == MP_QSTR_crc_target) {
+    dest[0] = mp_obj_new_int(header->crc_target);
+  } else if (attr == MP_QSTR_flags) {
+    dest[0] = mp_obj_new_int(header->flags);
+  } else if (attr == MP_QSTR_private_bits) {
+    dest[0] = mp_obj_new_int(header->private_bits);
+  } else if (attr == MP_QSTR_duration_seconds) {
+    dest[0] = mp_obj_new_int(mad_timer_count(header->duration, MAD_UNITS_SECONDS));
+  } else if (attr == MP_QSTR_duration_milliseconds) {
+    dest[0] = mp_obj_new_int(mad_timer_count(header->duration, MAD_UNITS_MILLISECONDS));
+  }
+}
+
 // Slot: make_new
 static mp_obj_t mp_make_new_decoder(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args_in) {
   mp_printf(&mp_plat_print, "mp_make_new_decoder(type, n_args=%d, n_kw=%d)\n", n_args, n_kw);
 
-  enum { ARG_cb_data, ARG_input, ARG_header, ARG_filter, ARG_output, ARG_error };
+  enum { ARG_cb_data, ARG_input, ARG_header, ARG_filter, ARG_output, ARG_error, ARG_arena,
+         ARG_buffer_size, ARG_block_size, ARG_low_water, ARG_deadline, ARG_governor, ARG_options };
   mp_arg_t allowed_args[] = {
       { MP_QSTR_ /* cb_data   */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none } },
-      { MP_QSTR_ /* input     */, MP_ARG_KW_ONLY | MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* input     */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
       { MP_QSTR_ /* header    */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
       { MP_QSTR_ /* filter    */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
       { MP_QSTR_ /* output    */, MP_ARG_KW_ONLY | MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL} },
       { MP_QSTR_ /* error     */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* arena     */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none } },
+      { MP_QSTR_ /* buffer_size */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = MP3_BUF_SIZE} },
+      { MP_QSTR_ /* block_size  */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1} },
+      { MP_QSTR_ /* low_water   */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+      { MP_QSTR_ /* deadline    */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1} },
+      { MP_QSTR_ /* governor    */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = DECODER_QUALITY_FULL} },
+      { MP_QSTR_ /* options     */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
   };
   // must load QSTRs at runtime since we are using dynruntime
   allowed_args[ARG_cb_data].qst = MP_QSTR_cb_data;
@@ -30,13 +215,39 @@ static mp_obj_t mp_make_new_decoder(const mp_obj_type_t *type, size_t n_args, si
   allowed_args[ARG_filter].qst = MP_QSTR_filter;
   allowed_args[ARG_output].qst = MP_QSTR_output;
   allowed_args[ARG_error].qst = MP_QSTR_error;
+  allowed_args[ARG_arena].qst = MP_QSTR_arena;
+  allowed_args[ARG_buffer_size].qst = MP_QSTR_buffer_size;
+  allowed_args[ARG_block_size].qst = MP_QSTR_block_size;
+  allowed_args[ARG_low_water].qst = MP_QSTR_low_water;
+  allowed_args[ARG_deadline].qst = MP_QSTR_deadline;
+  allowed_args[ARG_governor].qst = MP_QSTR_governor;
+  allowed_args[ARG_options].qst = MP_QSTR_options;
 
   // check arguments
-  mp_arg_check_num(n_args, n_kw, 0, 6, true);
+  mp_arg_check_num(n_args, n_kw, 0, 13, true);
 
   mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
   mp_arg_parse_all_kw_array(n_args, n_kw, args_in, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
 
+  // the ring has to hold a whole frame, in whole blocks
+  mp_int_t buffer_size = vals[ARG_buffer_size].u_int;
+  mp_int_t block_size = vals[ARG_block_size].u_int;
+  mp_int_t low_water = vals[ARG_low_water].u_int;
+  if (block_size < 1 || buffer_size < MP3_MIRROR_SIZE + block_size || buffer_size % block_size != 0) {
+    mp_raise_ValueError("buffer_size must be a multiple of block_size, and hold a frame plus a block");
+  }
+  if (low_water < 0 || low_water >= buffer_size) {
+    mp_raise_ValueError("low_water must be less than buffer_size");
+  }
+  mp_int_t governor = vals[ARG_governor].u_int;
+  check_quality(governor);
+  mp_int_t deadline = vals[ARG_deadline].u_int;
+  if (deadline == -1) {
+    deadline = (governor != DECODER_QUALITY_FULL) ? DEADLINE_GOVERNOR : 0;
+  }
+  check_deadline(deadline);
+  check_options(vals[ARG_options].u_int);
+
   // create the object
   mp_obj_libmad_decoder_t *self = mp_obj_malloc(mp_obj_libmad_decoder_t, type);
 
@@ -49,10 +260,70 @@ static mp_obj_t mp_make_new_decoder(const mp_obj_type_t *type, size_t n_args, si
   self->py_error_cb  = vals[ARG_error].u_obj;
 
   // hand 'self' object to C callbacks, so they can translate to Python callbacks
-  self->options = 0;
+  self->options = vals[ARG_options].u_int;
 
   self->running = false;
 
+  // input comes from the callback until from_buffer() is called
+  self->source = MP_OBJ_NULL;
+  self->source_first = 0;
+
+  // decoding runs in one go until pipeline() is called
+  self->pipe = NULL;
+
+  // frames are timed against their duration, see realtime()
+  self->deadline = deadline;
+  mp_obj_t time = mp_import_name(MP_QSTR_time, mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+  self->py_ticks_us = mp_load_attr(time, MP_QSTR_ticks_us);
+
+  // full quality until quality() or the governor says otherwise
+  self->quality = DECODER_QUALITY_FULL;
+  self->governor = governor;
+  self->quality_frames = 0;
+
+  // stream/frame/synth state is allocated or carved out once the first header arrives
+  self->state = NULL;
+  self->state_nch = 0;
+  self->state_layer3 = false;
+  self->pcm_view = pcm_view_new(MP_OBJ_FROM_PTR(self));
+  self->header_view = header_view_new();
+
+  self->ring_size = buffer_size;
+  self->block_size = block_size;
+  self->low_water = low_water;
+
+  // arena=buffer or arena=(buffer, ...): use caller supplied memory instead of the heap
+  self->n_arenas = 0;
+  self->arena_obj = vals[ARG_arena].u_obj;
+  if (self->arena_obj != mp_const_none) {
+    mp_obj_t *items = &self->arena_obj;
+    size_t count = 1;
+    mp_buffer_info_t bufinfo;
+
+    if (!mp_get_buffer(self->arena_obj, &bufinfo, MP_BUFFER_RW)) {
+      mp_obj_get_array(self->arena_obj, &count, &items);
+    }
+    if (count < 1 || count > DECODER_ARENAS_MAX) {
+      mp_raise_ValueError("expected 1 to 4 arenas");
+    }
+
+    unsigned char *base[DECODER_ARENAS_MAX];
+    size_t size[DECODER_ARENAS_MAX];
+    for (size_t i = 0; i < count; i++) {
+      if (!mp_get_buffer(items[i], &bufinfo, MP_BUFFER_RW)) {
+        mp_raise_TypeError("expected a writable buffer");
+      }
+      base[i] = bufinfo.buf;
+      size[i] = bufinfo.len;
+    }
+
+    if (!decoder_arena_init(self, base, size, count)) {
+      mp_raise_ValueError("last arena is smaller than the input buffer");
+    }
+  } else {
+    self->mp3buf = m_malloc(buffer_size + MP3_MIRROR_SIZE);
+  }
+
   return MP_OBJ_FROM_PTR(self);
 }
 
@@ -73,15 +344,207 @@ static void mp_libmad_decoder_print(const mp_print_t *print, mp_obj_t self_in, m
 static mp_obj_t mp_libmad_decoder_run(mp_obj_t self_in) {
   int result = 33; // debug return
   mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(self_in);
+  if (self->running) {
+    mp_raise_msg(&mp_type_RuntimeError, "decoder is already running");
+  }
+  // run() decodes both stages itself
+  mad_decoder_pipeline(self, 0, false);
   self->running = true;
   mp_printf(&mp_plat_print, "\n\nCalling mad_decoder_run(%p)...\n", self);
-  result = mad_decoder_run(self);
+  // a callback that raises unwinds straight through mad_decoder_run(), the decoder has to
+  // stop counting as running then too, or it could never be reset or run again
+  nlr_buf_t nlr;
+  if (nlr_push(&nlr) == 0) {
+    result = mad_decoder_run(self);
+    nlr_pop();
+  } else {
+    self->running = false;
+    nlr_raise(MP_OBJ_FROM_PTR(nlr.ret_val));
+  }
   mp_printf(&mp_plat_print, "mad_decoder_run returned %d\n", result);
   self->running = false;
   return mp_obj_new_int(result);
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(mp_libmad_decoder_run_obj, mp_libmad_decoder_run);
 
+// reset(cb_data=, input=, header=, filter=, output=, error=, deadline=, governor=, options=):
+// get ready for the next track. Reinitializes the stream, frame and synth in place and keeps the state block, so a
+// playlist can be played with one long-lived Decoder. Callbacks not passed are kept.
+static mp_obj_t mp_libmad_decoder_reset(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+
+  enum { ARG_cb_data, ARG_input, ARG_header, ARG_filter, ARG_output, ARG_error, ARG_deadline, ARG_governor, ARG_options };
+  mp_arg_t allowed_args[] = {
+      { MP_QSTR_ /* cb_data   */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* input     */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* header    */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* filter    */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* output    */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* error     */, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+      { MP_QSTR_ /* deadline  */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1} },
+      { MP_QSTR_ /* governor  */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1} },
+      { MP_QSTR_ /* options   */, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = -1} },
+  };
+  // must load QSTRs at runtime since we are using dynruntime
+  allowed_args[ARG_cb_data].qst = MP_QSTR_cb_data;
+  allowed_args[ARG_input].qst = MP_QSTR_input;
+  allowed_args[ARG_header].qst = MP_QSTR_header;
+  allowed_args[ARG_filter].qst = MP_QSTR_filter;
+  allowed_args[ARG_output].qst = MP_QSTR_output;
+  allowed_args[ARG_error].qst = MP_QSTR_error;
+  allowed_args[ARG_deadline].qst = MP_QSTR_deadline;
+  allowed_args[ARG_governor].qst = MP_QSTR_governor;
+  allowed_args[ARG_options].qst = MP_QSTR_options;
+
+  mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+  mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+
+  // the stream is in use until run() returns
+  if (self->running) {
+    mp_raise_msg(&mp_type_RuntimeError, "can't reset a running decoder");
+  }
+  if (vals[ARG_deadline].u_int != -1) {
+    check_deadline(vals[ARG_deadline].u_int);
+    self->deadline = vals[ARG_deadline].u_int;
+  }
+  if (vals[ARG_governor].u_int != -1) {
+    check_quality(vals[ARG_governor].u_int);
+    self->governor = vals[ARG_governor].u_int;
+    if (self->governor != DECODER_QUALITY_FULL && self->deadline == 0 && vals[ARG_deadline].u_int == -1) {
+      self->deadline = DEADLINE_GOVERNOR;
+    }
+  }
+  if (vals[ARG_options].u_int != -1) {
+    check_options(vals[ARG_options].u_int);
+    self->options = vals[ARG_options].u_int;
+  }
+
+  if (vals[ARG_cb_data].u_obj != MP_OBJ_NULL) self->cb_data      = vals[ARG_cb_data].u_obj;
+  if (vals[ARG_input].u_obj   != MP_OBJ_NULL) self->py_input_cb  = vals[ARG_input].u_obj;
+  if (vals[ARG_header].u_obj  != MP_OBJ_NULL) self->py_header_cb = vals[ARG_header].u_obj;
+  if (vals[ARG_filter].u_obj  != MP_OBJ_NULL) self->py_filter_cb = vals[ARG_filter].u_obj;
+  if (vals[ARG_output].u_obj  != MP_OBJ_NULL) self->py_output_cb = vals[ARG_output].u_obj;
+  if (vals[ARG_error].u_obj   != MP_OBJ_NULL) self->py_error_cb  = vals[ARG_error].u_obj;
+
+  // a new input callback replaces any buffer from from_buffer()
+  if (vals[ARG_input].u_obj != MP_OBJ_NULL) {
+    self->source = MP_OBJ_NULL;
+  }
+
+  mad_decoder_reset(self);
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(mp_libmad_decoder_reset_obj, 1, mp_libmad_decoder_reset);
+
+// from_buffer(buf): decode buf in place on the next run(), instead of calling the input callback.
+// buf can be read-only (bytes, a frozen constant, an mmap) and must hold the whole stream.
+// from_buffer(None), or reset(input=...), goes back to the input callback.
+// Frames starting before byte offset first are decoded but not output, to decode a chunk from split().
+static mp_obj_t from_buffer(size_t n_args, const mp_obj_t *args) {
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_obj_t buf_in = args[1];
+  mp_int_t first = (n_args > 2) ? mp_obj_get_int(args[2]) : 0;
+
+  if (self->running) {
+    mp_raise_msg(&mp_type_RuntimeError, "can't change the input of a running decoder");
+  }
+
+  if (buf_in == mp_const_none) {
+    self->source = MP_OBJ_NULL;
+  } else {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+    // keeping the object, not just its memory, keeps it alive
+    self->source = buf_in;
+  }
+  if (first < 0) {
+    mp_raise_ValueError("first must not be negative");
+  }
+  self->source_first = first;
+
+  mad_decoder_reset(self);
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(from_buffer_obj, 2, 3, from_buffer);
+
+// pipeline(depth, split=False): split decoding into a front and a back stage with a queue
+// of depth frames between them, and get ready to run them with run_stage(), see pipeline.py.
+// With split, the right channel of stereo frames is finished by STAGE_RIGHT in parallel.
+// pipeline(0) goes back to run(). Returns the bytes allocated for the queue.
+static mp_obj_t pipeline(size_t n_args, const mp_obj_t *args) {
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t depth = mp_obj_get_int(args[1]);
+  bool split = (n_args > 2) && mp_obj_is_true(args[2]);
+
+  if (self->running) {
+    mp_raise_msg(&mp_type_RuntimeError, "can't change the pipeline of a running decoder");
+  }
+  if (depth < 0) {
+    mp_raise_ValueError("depth must be 0 or more");
+  }
+  if (depth > 0 && self->py_input_cb == MP_OBJ_NULL && self->source == MP_OBJ_NULL) {
+    mp_raise_ValueError("decoder has no input");
+  }
+
+  long size = mad_decoder_pipeline(self, depth, split);
+  if (size < 0) {
+    mp_raise_ValueError("arenas too small for the pipeline");
+  }
+
+  return mp_obj_new_int(size);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pipeline_obj, 2, 3, pipeline);
+
+// run_stage(stage): run STAGE_FRONT, STAGE_BACK or STAGE_RIGHT until it has to wait for
+// another one, returning STAGE_WAIT, or the result run() would have (0 or -1) once it is done.
+// run_stage(STAGE_ABORT) winds both down, the back stage returns once the front has.
+static mp_obj_t run_stage(mp_obj_t self_in, mp_obj_t stage_in) {
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(self_in);
+  mp_int_t stage = mp_obj_get_int(stage_in);
+
+  if (self->pipe == NULL) {
+    mp_raise_msg(&mp_type_RuntimeError, "no pipeline, call pipeline() first");
+  }
+
+  switch (stage) {
+  case DECODER_STAGE_ABORT:
+    mad_decoder_abort(self);
+    return mp_const_none;
+  case DECODER_STAGE_FRONT:
+  case DECODER_STAGE_BACK:
+    break;
+  case DECODER_STAGE_RIGHT:
+    if (!self->pipe->split) {
+      mp_raise_ValueError("pipeline wasn't split");
+    }
+    break;
+  default:
+    mp_raise_ValueError("unknown stage");
+  }
+
+  // the same as run(): a callback that raises unwinds straight through the stage, which
+  // has to stop the pipeline and the decoder's running on its way out
+  int result = 0;
+  nlr_buf_t nlr;
+  if (nlr_push(&nlr) == 0) {
+    if (stage == DECODER_STAGE_FRONT) {
+      result = mad_decoder_front(self);
+    } else if (stage == DECODER_STAGE_BACK) {
+      result = mad_decoder_back(self);
+    } else {
+      result = mad_decoder_right(self);
+    }
+    nlr_pop();
+  } else {
+    mad_decoder_raised(self, stage);
+    nlr_raise(MP_OBJ_FROM_PTR(nlr.ret_val));
+  }
+  return mp_obj_new_int(result);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(run_stage_obj, run_stage);
+
 // Stream methods:
 // stream_buffer
 static mp_obj_t stream_buffer(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t len_in) {
@@ -108,7 +571,7 @@ static mp_obj_t stream_buffer(mp_obj_t self_in, mp_obj_t data_in, mp_obj_t len_i
 }
 static MP_DEFINE_CONST_FUN_OBJ_3(stream_buffer_obj, stream_buffer);
 
-// stream->pcm gets Q3.24 signed fixed point samples.
+// get_pcm(): the PCM view of the frame being output, None outside of run()
 static mp_obj_t get_pcm(mp_obj_t self_in) {
   mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(self_in);
 
@@ -118,30 +581,19 @@ static mp_obj_t get_pcm(mp_obj_t self_in) {
 
   struct mad_pcm *pcm = &self->synth.pcm;
 
-  // expecting width = 2 for 16bit pcm samples
-  int width = sizeof(pcm->samples[0][0]);
-
-  if (pcm->length < 1152 || self->data_left == NULL || self->data_right == NULL) {
-    // re-allocate these even if they're not null because this chunk has smaller output
-    self->data_left = mp_obj_new_bytearray_by_ref(width*pcm->length, (char *)pcm->samples[0]);
-    self->data_right = mp_obj_new_bytearray_by_ref(width*pcm->length, (char *)pcm->samples[1]);
+  if (pcm->samples == NULL) {
+    return mp_const_none;
   }
 
-  // return a dictionary with some PCM fields
-  mp_obj_t dict = mp_obj_new_dict(6);
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_channels), mp_obj_new_int(pcm->channels));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_samplerate), mp_obj_new_int(pcm->samplerate));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_width), mp_obj_new_int(width));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_length), mp_obj_new_int(pcm->length));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_left), self->data_left);
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_right), self->data_right);
+  // a new frame for the views, copied when they're read
+  pcm_view_t *view = MP_OBJ_TO_PTR(self->pcm_view);
+  view->stale = (1 << PCM_VIEWS) - 1;
 
-  return dict;
+  return self->pcm_view;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(get_pcm_obj, get_pcm);
 
-// Frame methods:
-// frame->header 
+// get_frame_header(): the header view of the frame being output, None outside of run()
 static mp_obj_t get_frame_header(mp_obj_t self_in) {
   mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(self_in);
 
@@ -149,31 +601,339 @@ static mp_obj_t get_frame_header(mp_obj_t self_in) {
     return mp_const_none;
   }
 
-  struct mad_header *header = &self->frame.header;
-
-  // return a dictionary with some header fields
-  mp_obj_t dict = mp_obj_new_dict(5);
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_layer), mp_obj_new_int(header->layer));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_mode), mp_obj_new_int(header->mode));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_mode_extension), mp_obj_new_int(header->mode_extension));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_emphasis), mp_obj_new_int(header->emphasis));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_bitrate), mp_obj_new_int(header->bitrate));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_samplerate), mp_obj_new_int(header->samplerate));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_crc_check), mp_obj_new_int(header->crc_check));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_crc_target), mp_obj_new_int(header->crc_target));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_flags), mp_obj_new_int(header->flags));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_private_bits), mp_obj_new_int(header->private_bits));
-
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_duration_seconds), mp_obj_new_int(mad_timer_count(header->duration, MAD_UNITS_SECONDS)));
-  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_duration_milliseconds), mp_obj_new_int(mad_timer_count(header->duration, MAD_UNITS_MILLISECONDS)));
-  
-  return dict;
+  // with a pipeline the front stage is ahead, the frame being output is the back stage's
+  header_view_t *view = MP_OBJ_TO_PTR(self->header_view);
+  view->header = self->pipe ? self->pipe->frame.header : self->frame.header;
+
+  return self->header_view;
 }
 static MP_DEFINE_CONST_FUN_OBJ_1(get_frame_header_obj, get_frame_header);
 
 
+// stats(): where the decoding time goes. With the module built with -DMAD_STATS (see the
+// Makefile) a dict of (total, max, count) per stage since the last run() or reset(): ticks
+// spent in it, the longest single call and the number of calls, plus 'clock', the unit of
+// the ticks. Without MAD_STATS the dict is empty.
+#if defined(MAD_STATS)
+static mp_obj_t new_int_u64(uint64_t value) {
+  if ((value >> 30) == 0) {
+    return mp_obj_new_int(value);
+  }
+  mp_obj_t high = mp_binary_op(MP_BINARY_OP_LSHIFT, mp_obj_new_int_from_uint(value >> 32), mp_obj_new_int(32));
+  return mp_binary_op(MP_BINARY_OP_ADD, high, mp_obj_new_int_from_uint((uint32_t)value));
+}
+#endif
+
+static mp_obj_t stats(mp_obj_t self_in) {
+  mp_obj_t dict = mp_obj_new_dict(MAD_STAGE_COUNT + 1);
+
+#if defined(MAD_STATS)
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(self_in);
+  static const qstr names[MAD_STAGE_COUNT] = {
+    [MAD_STAGE_HEADER]   = MP_QSTR_header,
+    [MAD_STAGE_SIDEINFO] = MP_QSTR_sideinfo,
+    [MAD_STAGE_HUFFMAN]  = MP_QSTR_huffman,
+    [MAD_STAGE_STEREO]   = MP_QSTR_stereo,
+    [MAD_STAGE_IMDCT]    = MP_QSTR_imdct,
+    [MAD_STAGE_SYNTH]    = MP_QSTR_synth,
+    [MAD_STAGE_INPUT]    = MP_QSTR_input,
+    [MAD_STAGE_OUTPUT]   = MP_QSTR_output,
+  };
+
+  for (int i = 0; i < MAD_STAGE_COUNT; i++) {
+    mp_obj_t items[3] = {
+      new_int_u64(self->stats.total[i]),
+      mp_obj_new_int_from_uint(self->stats.max[i]),
+      mp_obj_new_int_from_uint(self->stats.count[i]),
+    };
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(names[i]), mp_obj_new_tuple(3, items));
+  }
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_clock), mp_obj_new_str(MAD_TICKS_UNIT, sizeof(MAD_TICKS_UNIT) - 1));
+#endif
+
+  return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(stats_obj, stats);
+
+// realtime(): how close run() or the pipeline is to falling behind playback, since the last
+// run() or reset(). Returns (rtf, worst_us, misses, frames): the decoding time of a frame over
+// its playing time, averaged over the last 16 frames or so, the longest frame in microseconds,
+// the frames that took more than deadline percent of their playing time, and the frames timed.
+// The input and output callbacks aren't counted. Cheap enough to call from the output callback.
+static mp_obj_t realtime(mp_obj_t self_in) {
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(self_in);
+
+  // rt_average is in 1/1024ths, times 16
+  mp_obj_t items[4] = {
+    mp_binary_op(MP_BINARY_OP_TRUE_DIVIDE, mp_obj_new_int_from_uint(self->rt_average), mp_obj_new_int(16 << 10)),
+    mp_obj_new_int_from_uint(self->rt_worst_us),
+    mp_obj_new_int_from_uint(self->rt_misses),
+    mp_obj_new_int_from_uint(self->rt_frames),
+  };
+  return mp_obj_new_tuple(4, items);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(realtime_obj, realtime);
+
+// quality(level=None): the quality level frames are decoded at, QUALITY_FULL down to
+// QUALITY_HALFRATE, and with a level, set it. The level carries over from track to track;
+// with Decoder(governor=) the governor steps it down when decoding falls behind real time
+// and back up when it catches up again, never below the governor level. Can be called
+// from the callbacks while decoding.
+static mp_obj_t quality(size_t n_args, const mp_obj_t *args) {
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(args[0]);
+
+  if (n_args > 1) {
+    mp_int_t level = mp_obj_get_int(args[1]);
+    check_quality(level);
+    self->quality = level;
+    self->quality_frames = 0;
+  }
+  return mp_obj_new_int(self->quality);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(quality_obj, 1, 2, quality);
+
+// Module functions:
+// pin_tables(which=PIN_ALL): copy hot decoder tables out of flash into a RAM block.
+// which is a mask of PIN_SYNTH, PIN_IMDCT and PIN_HUFFMAN, 0 restores the built-in tables.
+// Returns the number of bytes of RAM used.
+enum {
+  PIN_SYNTH   = 0x0001, // synth.c D[17][32] window
+  PIN_IMDCT   = 0x0002, // layer3.c window_l, window_s, imdct_s
+  PIN_HUFFMAN = 0x0004, // huffman.c code tables
+  PIN_ALL     = 0x0007
+};
+
+// the module's own globals, captured by mpy_init(): mp_store_global() at call time would
+// store into the caller's, and the natmod's statics aren't a GC root, so the block hangs
+// off the module dict instead
+static mp_obj_dict_t *mod_globals;
+
+static void pin_tables_keep(mp_obj_t block) {
+  mp_obj_dict_store(MP_OBJ_FROM_PTR(mod_globals), MP_OBJ_NEW_QSTR(MP_QSTR__pinned_tables), block);
+}
+
+static mp_obj_t pin_tables(size_t n_args, const mp_obj_t *args) {
+  int which = (n_args > 0) ? mp_obj_get_int(args[0]) : PIN_ALL;
+
+  // passing NULL puts the kernels back on the built-in tables and tells us the size of a copy
+  unsigned long synth_size = mad_synth_pin(NULL);
+  unsigned long imdct_size = mad_layer_III_pin(NULL);
+  unsigned long huff_size  = mad_huff_pin(NULL);
+  unsigned long size = 0;
+
+  // any previous block is unused now, let the GC have it
+  pin_tables_keep(mp_const_none);
+
+  if (which & PIN_SYNTH) size += synth_size;
+  if (which & PIN_IMDCT) size += imdct_size;
+  if (which & PIN_HUFFMAN) size += huff_size;
+
+  if (size == 0) {
+    return mp_obj_new_int(0);
+  }
+
+  unsigned char *block = m_malloc(size);
+  unsigned char *next = block;
+
+  if (which & PIN_SYNTH) next += mad_synth_pin(next);
+  if (which & PIN_IMDCT) next += mad_layer_III_pin(next);
+  if (which & PIN_HUFFMAN) next += mad_huff_pin(next);
+
+  // keep the block reachable from the module globals so the GC doesn't collect it
+  pin_tables_keep(mp_obj_new_bytearray_by_ref(size, block));
+
+  return mp_obj_new_int(size);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pin_tables_obj, 0, 1, pin_tables);
+
+// Memory footprint:
+// returns a dict of bytes used by the decoder object and each part of its separate state,
+// 'arena' is the size of a single arena that holds all of it but the object itself
+static mp_obj_t footprint_dict(bool layer3, unsigned int nch, unsigned int ring_size) {
+  decoder_footprint_t fp;
+  decoder_footprint(&fp, layer3, nch, ring_size);
+
+  mp_obj_t dict = mp_obj_new_dict(10);
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_decoder), mp_obj_new_int(sizeof(mp_obj_libmad_decoder_t)));
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_sbsample), mp_obj_new_int(fp.sbsample));
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_filter), mp_obj_new_int(fp.filter));
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_pcm), mp_obj_new_int(fp.pcm));
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_overlap), mp_obj_new_int(fp.overlap));
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_main_data), mp_obj_new_int(fp.main_data));
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_mp3buf), mp_obj_new_int(fp.mp3buf));
+  // the first part is aligned up from the arena's start, which costs up to 7 bytes
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_arena), mp_obj_new_int(fp.total + fp.mp3buf + DECODER_ARENA_ALIGN - 1));
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_total), mp_obj_new_int(sizeof(mp_obj_libmad_decoder_t) + fp.total + fp.mp3buf));
+
+  return dict;
+}
+
+// Decoder.footprint(): what this decoder has allocated so far
+static mp_obj_t decoder_footprint_get(mp_obj_t self_in) {
+  mp_obj_libmad_decoder_t *self = MP_OBJ_TO_PTR(self_in);
+  mp_obj_t dict = footprint_dict(self->state_layer3, self->state_nch, self->ring_size);
+  mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_pipeline), mp_obj_new_int(self->pipe ? self->pipe->size : 0));
+  return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(decoder_footprint_obj, decoder_footprint_get);
+
+// mplibmad.footprint(layer, channels, buffer_size=4096): what a decoder needs for a stream
+// of this layer and channel count
+static mp_obj_t footprint(size_t n_args, const mp_obj_t *args) {
+  int layer = mp_obj_get_int(args[0]);
+  int channels = mp_obj_get_int(args[1]);
+  int buffer_size = (n_args > 2) ? mp_obj_get_int(args[2]) : MP3_BUF_SIZE;
+
+  if (layer < MAD_LAYER_I || layer > MAD_LAYER_III || channels < 1 || channels > 2) {
+    mp_raise_ValueError("layer must be 1-3 and channels 1-2");
+  }
+
+  return footprint_dict(layer == MAD_LAYER_III, channels, buffer_size);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(footprint_obj, 2, 3, footprint);
+
+// mplibmad.split(buf, chunks): cut the mp3 stream in buf at frame boundaries into up to chunks
+// pieces that decode independently, e.g. on different cores, see split.c. Returns a list of
+// (start, first, end) byte offsets, decode a chunk with from_buffer(buf[start:end], first - start)
+// and the outputs joined in order are the same as decoding buf in one go.
+static mp_obj_t split(mp_obj_t buf_in, mp_obj_t chunks_in) {
+  mp_buffer_info_t bufinfo;
+  mp_get_buffer_raise(buf_in, &bufinfo, MP_BUFFER_READ);
+  mp_int_t count = mp_obj_get_int(chunks_in);
+
+  if (count < 1) {
+    mp_raise_ValueError("chunks must be at least 1");
+  }
+
+  // count the frames first, then scan again for their offsets
+  unsigned long frames = split_scan(bufinfo.buf, bufinfo.len, NULL, 0);
+  mp_obj_t list = mp_obj_new_list(0, NULL);
+  if (frames == 0) {
+    return list;
+  }
+
+  unsigned long *offset = m_malloc(frames * sizeof(*offset));
+  split_chunk_t *chunk = m_malloc(count * sizeof(*chunk));
+  split_scan(bufinfo.buf, bufinfo.len, offset, frames);
+  unsigned int n = split_chunks(offset, frames, bufinfo.len, count, chunk);
+
+  for (unsigned int i = 0; i < n; i++) {
+    mp_obj_t items[3] = {
+      mp_obj_new_int(chunk[i].start),
+      mp_obj_new_int(chunk[i].first),
+      mp_obj_new_int(chunk[i].end),
+    };
+    mp_obj_list_append(list, mp_obj_new_tuple(3, items));
+  }
+
+  m_free(chunk);
+  m_free(offset);
+
+  return list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(split_obj, split);
+
+// mplibmad.scan(source, buf=None, tail=None): duration, bitrate and tags of an mp3 without
+// decoding it, see scan.c. source is a bytes-like object or a stream with readinto(), buf a
+// bytearray of at least SCAN_BUF_SIZE bytes to read through (allocated when not given), and
+// tail the last 128 bytes of the stream, for an ID3v1 tag when the scan stops at a Xing header.
+// Returns None when there's no MPEG audio, or a tuple
+// (duration_ms, bitrate, samplerate, channels, layer, frames, vbr, title, artist, album, year,
+// track, genre) with None for missing tags. See scan.py for scanning many files at once.
+typedef struct {
+  mp_obj_t readinto;        // bound readinto() of a stream source
+  const unsigned char *buf; // or the data of a bytes-like one
+  size_t len;
+  size_t pos;
+} scan_source_t;
+
+static unsigned long scan_read(void *ctx, unsigned char *buf, unsigned long len) {
+  scan_source_t *source = ctx;
+
+  if (source->readinto == MP_OBJ_NULL) {
+    if (len > source->len - source->pos) {
+      len = source->len - source->pos;
+    }
+    memcpy(buf, source->buf + source->pos, len);
+    source->pos += len;
+    return len;
+  }
+
+  mp_obj_t args[1] = { mp_obj_new_bytearray_by_ref(len, buf) };
+  mp_obj_t result = mp_call_function_n_kw(source->readinto, 1, 0, args);
+  // None from a non-blocking stream with nothing to read ends the scan too
+  return (result == mp_const_none) ? 0 : mp_obj_get_int(result);
+}
+
+static mp_obj_t scan(size_t n_args, const mp_obj_t *args) {
+  scan_source_t source = { MP_OBJ_NULL, NULL, 0, 0 };
+  mp_buffer_info_t bufinfo;
+  unsigned char *buf;
+  size_t size = SCAN_BUF_SIZE;
+  scan_info_t info;
+
+  if (mp_get_buffer(args[0], &bufinfo, MP_BUFFER_READ)) {
+    source.buf = bufinfo.buf;
+    source.len = bufinfo.len;
+  } else {
+    source.readinto = mp_load_attr(args[0], MP_QSTR_readinto);
+  }
+
+  if (n_args > 1 && args[1] != mp_const_none) {
+    mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_RW);
+    if (bufinfo.len < SCAN_BUF_MIN) {
+      mp_raise_ValueError("buf too small");
+    }
+    buf = bufinfo.buf;
+    size = bufinfo.len;
+  } else {
+    buf = m_malloc(size);
+  }
+
+  int result = scan_stream(&info, scan_read, &source, buf, size);
+
+  if (!(n_args > 1 && args[1] != mp_const_none)) {
+    m_free(buf);
+  }
+  if (result == -1) {
+    return mp_const_none;
+  }
+
+  // the scan stopped at the Xing header, look at the tail for an ID3v1 tag
+  if (!info.at_end) {
+    if (source.readinto == MP_OBJ_NULL && source.len >= 128) {
+      scan_id3v1(&info, source.buf + source.len - 128);
+    } else if (n_args > 2 && args[2] != mp_const_none) {
+      mp_get_buffer_raise(args[2], &bufinfo, MP_BUFFER_READ);
+      if (bufinfo.len >= 128) {
+        scan_id3v1(&info, (const unsigned char *)bufinfo.buf + bufinfo.len - 128);
+      }
+    }
+  }
+
+  mp_obj_t items[7 + SCAN_TAGS] = {
+    mp_obj_new_int(info.duration_ms),
+    mp_obj_new_int(info.bitrate),
+    mp_obj_new_int(info.samplerate),
+    mp_obj_new_int(info.channels),
+    mp_obj_new_int(info.layer),
+    mp_obj_new_int(info.frames),
+    mp_obj_new_bool(info.vbr),
+  };
+  for (int i = 0; i < SCAN_TAGS; i++) {
+    size_t len = 0;
+    while (info.tag[i][len]) {
+      len++;
+    }
+    items[7 + i] = len ? mp_obj_new_str(info.tag[i], len) : mp_const_none;
+  }
+
+  return mp_obj_new_tuple(7 + SCAN_TAGS, items);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(scan_obj, 1, 3, scan);
+
 // define a local dictionary table
-mp_map_elem_t mod_locals_dict_table[8];
+mp_map_elem_t mod_locals_dict_table[12];
 static MP_DEFINE_CONST_DICT(mod_locals_dict, mod_locals_dict_table);
 // End Implementation of libmad.Decoder
 
@@ -195,8 +955,27 @@ mp_obj_t mpy_init(mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, mp_obj_t *a
   mod_locals_dict_table[1] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_stream_buffer), MP_OBJ_FROM_PTR(&stream_buffer_obj) };
   mod_locals_dict_table[2] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_get_frame_header), MP_OBJ_FROM_PTR(&get_frame_header_obj) };
   mod_locals_dict_table[3] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_get_pcm), MP_OBJ_FROM_PTR(&get_pcm_obj) };
+  mod_locals_dict_table[4] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_footprint), MP_OBJ_FROM_PTR(&decoder_footprint_obj) };
+  mod_locals_dict_table[5] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_reset), MP_OBJ_FROM_PTR(&mp_libmad_decoder_reset_obj) };
+  mod_locals_dict_table[6] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_from_buffer), MP_OBJ_FROM_PTR(&from_buffer_obj) };
+  mod_locals_dict_table[7] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_pipeline), MP_OBJ_FROM_PTR(&pipeline_obj) };
+  mod_locals_dict_table[8] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_run_stage), MP_OBJ_FROM_PTR(&run_stage_obj) };
+  mod_locals_dict_table[9] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_stats), MP_OBJ_FROM_PTR(&stats_obj) };
+  mod_locals_dict_table[10] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_realtime), MP_OBJ_FROM_PTR(&realtime_obj) };
+  mod_locals_dict_table[11] = (mp_map_elem_t){ MP_OBJ_NEW_QSTR(MP_QSTR_quality), MP_OBJ_FROM_PTR(&quality_obj) };
   MP_OBJ_TYPE_SET_SLOT(&mp_type_libmad_decoder, locals_dict, &mod_locals_dict, 2);
 
+  // the frame views have no constructor, only attributes
+  mp_type_libmad_pcm.base.type = &mp_type_type;
+  mp_type_libmad_pcm.flags = MP_TYPE_FLAG_NONE;
+  mp_type_libmad_pcm.name = MP_QSTR_PCM;
+  MP_OBJ_TYPE_SET_SLOT(&mp_type_libmad_pcm, attr, pcm_view_attr, 0);
+
+  mp_type_libmad_header.base.type = &mp_type_type;
+  mp_type_libmad_header.flags = MP_TYPE_FLAG_NONE;
+  mp_type_libmad_header.name = MP_QSTR_Header;
+  MP_OBJ_TYPE_SET_SLOT(&mp_type_libmad_header, attr, header_view_attr, 0);
+
   // Make the Decoder type available on the module
   mp_store_global(MP_QSTR_Decoder, MP_OBJ_FROM_PTR(&mp_type_libmad_decoder));
 
@@ -206,8 +985,39 @@ mp_obj_t mpy_init(mp_obj_fun_bc_t *self, size_t n_args, size_t n_kw, mp_obj_t *a
   mp_store_global(MP_QSTR_MAD_FLOW_BREAK, mp_obj_new_int(MAD_FLOW_BREAK));
   mp_store_global(MP_QSTR_MAD_FLOW_IGNORE, mp_obj_new_int(MAD_FLOW_IGNORE));
 
+  mp_store_global(MP_QSTR_PIN_SYNTH, mp_obj_new_int(PIN_SYNTH));
+  mp_store_global(MP_QSTR_PIN_IMDCT, mp_obj_new_int(PIN_IMDCT));
+  mp_store_global(MP_QSTR_PIN_HUFFMAN, mp_obj_new_int(PIN_HUFFMAN));
+  mp_store_global(MP_QSTR_PIN_ALL, mp_obj_new_int(PIN_ALL));
+
+  mp_store_global(MP_QSTR_STAGE_ABORT, mp_obj_new_int(DECODER_STAGE_ABORT));
+  mp_store_global(MP_QSTR_STAGE_FRONT, mp_obj_new_int(DECODER_STAGE_FRONT));
+  mp_store_global(MP_QSTR_STAGE_BACK, mp_obj_new_int(DECODER_STAGE_BACK));
+  mp_store_global(MP_QSTR_STAGE_RIGHT, mp_obj_new_int(DECODER_STAGE_RIGHT));
+  mp_store_global(MP_QSTR_STAGE_WAIT, mp_obj_new_int(DECODER_STAGE_WAIT));
+
+  mp_store_global(MP_QSTR_MAD_OPTION_IGNORECRC, mp_obj_new_int(MAD_OPTION_IGNORECRC));
+  mp_store_global(MP_QSTR_MAD_OPTION_HALFSAMPLERATE, mp_obj_new_int(MAD_OPTION_HALFSAMPLERATE));
+  mp_store_global(MP_QSTR_MAD_OPTION_QUARTERSAMPLERATE, mp_obj_new_int(MAD_OPTION_QUARTERSAMPLERATE));
+  mp_store_global(MP_QSTR_MAD_OPTION_EIGHTHSAMPLERATE, mp_obj_new_int(MAD_OPTION_EIGHTHSAMPLERATE));
+  mp_store_global(MP_QSTR_MAD_OPTION_SSO, mp_obj_new_int(MAD_OPTION_SSO));
+  mp_store_global(MP_QSTR_MAD_OPTION_SINGLECHANNEL, mp_obj_new_int(MAD_OPTION_SINGLECHANNEL));
+
+  mp_store_global(MP_QSTR_QUALITY_FULL, mp_obj_new_int(DECODER_QUALITY_FULL));
+  mp_store_global(MP_QSTR_QUALITY_SSO, mp_obj_new_int(DECODER_QUALITY_SSO));
+  mp_store_global(MP_QSTR_QUALITY_SUBBANDS, mp_obj_new_int(DECODER_QUALITY_SUBBANDS));
+  mp_store_global(MP_QSTR_QUALITY_MONO, mp_obj_new_int(DECODER_QUALITY_MONO));
+  mp_store_global(MP_QSTR_QUALITY_HALFRATE, mp_obj_new_int(DECODER_QUALITY_HALFRATE));
+
+  mp_store_global(MP_QSTR_SCAN_BUF_SIZE, mp_obj_new_int(SCAN_BUF_SIZE));
+
   // add module-level function calls here
   //mp_store_global(MP_QSTR_hello, MP_OBJ_FROM_PTR(&hello_obj));
+  mod_globals = self->context->module.globals;
+  mp_store_global(MP_QSTR_pin_tables, MP_OBJ_FROM_PTR(&pin_tables_obj));
+  mp_store_global(MP_QSTR_footprint, MP_OBJ_FROM_PTR(&footprint_obj));
+  mp_store_global(MP_QSTR_split, MP_OBJ_FROM_PTR(&split_obj));
+  mp_store_global(MP_QSTR_scan, MP_OBJ_FROM_PTR(&scan_obj));
 
   MP_DYNRUNTIME_INIT_EXIT
 }
@@ -3,8 +3,12 @@
 
 #include <py/dynruntime.h>
 #include "libmad/mad.h"
+#include "libmad/huffman.h"
+#include "libmad/layer3.h"
 
 #include "decoder.h"
+#include "split.h"
+#include "scan.h"
 
 #endif // MPY_LIBMAD_MODULE_H
 
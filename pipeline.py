@@ -0,0 +1,105 @@
+"""
+two stage decoding for mplibmad.Decoder, to use both cores of an RP2040 or
+RP2350. Only the rp2 port runs its threads in parallel, without a GIL; on
+ports with one (ESP32, unix) the stages take turns on one core.
+
+The front stage (input, headers, Huffman decoding and requantization) runs
+on a thread started with _thread, which is the second core on rp2, and the
+back stage (IMDCT, synthesis and the output callback) on the calling thread,
+with a queue of `depth` frames between them. The input callback is called
+from the front thread and the output callback from the caller's.
+
+With split=True the thread also finishes and synthesizes the right channel
+of each stereo frame (STAGE_RIGHT) while the calling thread does the left
+one, which roughly halves the time from a frame's input to its output. Use
+depth=1 with it when latency matters more than throughput.
+
+Neither stage blocks in native code: each returns STAGE_WAIT when it has
+to wait for another one, and is called again after a sleep_ms(0), which
+is where a port with a GIL lets the other thread run.
+
+    decoder = mplibmad.Decoder(input=input_callback, output=output_callback)
+    result = pipeline.run(decoder, depth=2)
+"""
+import _thread
+import time
+
+import mplibmad
+
+
+class Pipeline:
+    def __init__(self, decoder, depth=2, split=False):
+        self.decoder = decoder
+        self.depth = depth
+        self.split = split
+        self.size = decoder.pipeline(depth, split)  # bytes used by the frame queue
+        self.error = None
+        self.helper_done = False
+
+        # stall counters
+        self.front_waits = 0  # times the helper thread found nothing to do
+        self.back_waits = 0   # times the queue was empty
+
+    # helper thread: the front stage, and the right channel stage when split
+    def _helper(self):
+        decoder = self.decoder
+        front_done = False
+        while True:
+            if not front_done:
+                try:
+                    front_done = decoder.run_stage(mplibmad.STAGE_FRONT) != mplibmad.STAGE_WAIT
+                except Exception as e:
+                    # run_stage() has aborted the pipeline and finished the front stage already
+                    self.error = e
+                    front_done = True
+            if self.split:
+                # keep serving the back stage until it has finished, even after an error
+                if decoder.run_stage(mplibmad.STAGE_RIGHT) != mplibmad.STAGE_WAIT:
+                    break
+            elif front_done:
+                break
+            self.front_waits += 1
+            time.sleep_ms(0)
+        self.helper_done = True
+
+    def run(self):
+        decoder = self.decoder
+        _thread.start_new_thread(self._helper, ())
+
+        error = None
+        while True:
+            try:
+                result = decoder.run_stage(mplibmad.STAGE_BACK)
+            except Exception as e:
+                # run_stage() has aborted the pipeline, drain the queue and wait for the
+                # front stage to stop before raising
+                if error is None:
+                    error = e
+                continue
+            if result != mplibmad.STAGE_WAIT:
+                break
+            self.back_waits += 1
+            time.sleep_ms(0)
+
+        # the decoder is free for reuse once the helper has stopped calling it
+        while not self.helper_done:
+            time.sleep_ms(0)
+
+        if error is None:
+            error = self.error
+        if error is not None:
+            raise error
+        return result
+
+    def stats(self):
+        return {
+            'depth': self.depth,
+            'split': self.split,
+            'size': self.size,
+            'front_waits': self.front_waits,
+            'back_waits': self.back_waits,
+        }
+
+
+def run(decoder, depth=2, split=False):
+    return Pipeline(decoder, depth, split).run()
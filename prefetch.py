@@ -0,0 +1,148 @@
+"""
+read-ahead for mplibmad.Decoder input, so a slow readinto() (network backed
+storage, an SD card) doesn't stall the decode loop.
+
+A reader thread started with _thread fills a ring of input blocks from the
+source, and Prefetcher.input is the Decoder's input callback that drains it.
+The ring has a single producer and a single consumer: the reader only ever
+advances `head` and the decoder only ever advances `tail`, and a block is
+published by bumping `head` after it has been filled, so neither side needs
+a lock.
+
+    with open("song.mp3", "rb") as f, Prefetcher(f, depth=8) as pf:
+        decoder = mplibmad.Decoder(input=pf.input, output=output_callback)
+        decoder.run()
+        print(pf.stats())
+"""
+import _thread
+import time
+
+
+class Prefetcher:
+    def __init__(self, source, depth=4, block_size=4096):
+        if depth < 2:
+            raise ValueError("depth must be at least 2")
+        self.source = source
+        self.depth = depth
+        self.blocks = [bytearray(block_size) for _ in range(depth)]
+        self.lengths = [0] * depth  # bytes in each block, 0 marks the end of input
+
+        self.head = 0    # blocks filled, written by the reader only
+        self.tail = 0    # blocks drained, written by the decoder only
+        self.offset = 0  # bytes already handed out from the block at tail
+
+        self.running = False
+        self.reader_done = True  # set by the reader thread as it exits
+        self.error = None
+
+        # stall counters
+        self.reads = 0            # blocks read from the source
+        self.consumer_stalls = 0  # times the decoder found the ring empty and waited
+        self.consumer_wait_us = 0 # total time it waited
+        self.producer_stalls = 0  # times the reader found the ring full
+
+    def start(self):
+        self.running = True
+        self.reader_done = False
+        _thread.start_new_thread(self._reader, ())
+        return self
+
+    # waits for the reader, which may be in the middle of a readinto(), so the source
+    # can be closed once this returns
+    def stop(self):
+        self.running = False
+        while not self.reader_done:
+            time.sleep_ms(1)
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.stop()
+
+    def stats(self):
+        return {
+            'depth': self.depth,
+            'reads': self.reads,
+            'queued': self.head - self.tail,
+            'consumer_stalls': self.consumer_stalls,
+            'consumer_wait_us': self.consumer_wait_us,
+            'producer_stalls': self.producer_stalls,
+        }
+
+    # reader thread
+    def _fill(self, block):
+        mv = memoryview(block)
+        n = 0
+        while n < len(block):
+            retval = self.source.readinto(mv[n:])
+            if not retval:
+                break
+            n += retval
+        return n
+
+    def _reader(self):
+        stalled = False
+        try:
+            while self.running:
+                if self.head - self.tail == self.depth:
+                    # ring full, the decoder is ahead of us for now
+                    if not stalled:
+                        self.producer_stalls += 1
+                        stalled = True
+                    time.sleep_ms(1)
+                    continue
+                stalled = False
+
+                slot = self.head % self.depth
+                n = self._fill(self.blocks[slot])
+                self.lengths[slot] = n
+                self.head += 1
+                if n == 0:
+                    break
+                self.reads += 1
+        except Exception as e:
+            self.error = e
+        self.running = False
+        self.reader_done = True
+
+    # Decoder input callback, runs on the decoding thread
+    def input(self, decoder, data, buffer):
+        mv = memoryview(buffer)
+        room = len(buffer)
+        n = 0
+
+        while n < room:
+            if self.tail == self.head:
+                # ring empty: hand over what we have rather than wait
+                if n:
+                    break
+                # the reader has gone without queueing the end of input (stop() or an error),
+                # looking at head again after running so a last block isn't missed
+                if not self.running and self.tail == self.head:
+                    if self.error is not None:
+                        raise self.error
+                    break
+                self.consumer_stalls += 1
+                start = time.ticks_us()
+                while self.tail == self.head and self.running:
+                    time.sleep_ms(1)
+                self.consumer_wait_us += time.ticks_diff(time.ticks_us(), start)
+                continue
+
+            slot = self.tail % self.depth
+            length = self.lengths[slot]
+            if length == 0:
+                # end of input, leave the marker in place for any later calls
+                break
+
+            take = min(length - self.offset, room - n)
+            mv[n:n + take] = memoryview(self.blocks[slot])[self.offset:self.offset + take]
+            n += take
+            self.offset += take
+            if self.offset == length:
+                self.offset = 0
+                self.tail += 1
+
+        return n
+
@@ -0,0 +1,535 @@
+/*
+ * Scanning an mp3 for its duration, bitrate and tags without decoding it
+ *
+ * scan_stream() reads a stream from the start through a callback:
+ *   - ID3v2 tags in front of the audio, keeping the common text frames
+ *   - the first frame, and when it carries a Xing, Info or VBRI header with
+ *     a frame count the duration comes from that and the scan stops there
+ *   - otherwise every frame header, with libmad's mad_header_decode(), which
+ *     only looks at the 4 byte header and the frame length and skips the rest
+ *   - an ID3v1 tag in the last 128 bytes, when the scan got that far
+ * scan_id3v1() is there for callers that can seek to the tail themselves
+ * after a scan stopped at the Xing header.
+ *
+ * Nothing is allocated, all the state is on the stack and in the caller's
+ * buffer, so any number of scans can run at the same time on different
+ * threads. Only libmad and memcpy/memmove/memset are used, the MicroPython
+ * binding is in module.c.
+ */
+#include <string.h>
+
+#include "scan.h"
+
+typedef struct {
+  scan_read_t read;
+  void *ctx;
+  unsigned char *buf;
+  unsigned long size;       // usable bytes of buf, MAD_BUFFER_GUARD less than given
+  unsigned long pos;        // next unread byte
+  unsigned long fill;       // end of the data in buf
+  bool eof;
+  unsigned char tail[128];  // last 128 bytes read, for ID3v1
+  unsigned long total;      // bytes read
+} reader_t;
+
+static bool same(unsigned char const *p, char const *id, unsigned int n) {
+  for (unsigned int i = 0; i < n; i++) {
+    if (p[i] != (unsigned char)id[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static unsigned long be32(unsigned char const *p) {
+  return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+}
+
+static unsigned long syncsafe(unsigned char const *p) {
+  return ((unsigned long)(p[0] & 0x7f) << 21) | ((p[1] & 0x7f) << 14) | ((p[2] & 0x7f) << 7) | (p[3] & 0x7f);
+}
+
+static void keep_tail(reader_t *r, unsigned char const *p, unsigned long n) {
+  if (n >= sizeof(r->tail)) {
+    memcpy(r->tail, p + n - sizeof(r->tail), sizeof(r->tail));
+  } else {
+    memmove(r->tail, r->tail + n, sizeof(r->tail) - n);
+    memcpy(r->tail + sizeof(r->tail) - n, p, n);
+  }
+  r->total += n;
+}
+
+// make at least want bytes available from pos, fewer at the end of the stream,
+// returns the bytes available
+static unsigned long reader_fill(reader_t *r, unsigned long want) {
+  if (want > r->size) {
+    want = r->size;
+  }
+  if (r->fill - r->pos >= want || r->eof) {
+    return r->fill - r->pos;
+  }
+
+  memmove(r->buf, r->buf + r->pos, r->fill - r->pos);
+  r->fill -= r->pos;
+  r->pos = 0;
+
+  while (r->fill < want && !r->eof) {
+    unsigned long n = r->read(r->ctx, r->buf + r->fill, r->size - r->fill);
+    if (n == 0) {
+      r->eof = true;
+    } else {
+      keep_tail(r, r->buf + r->fill, n);
+      r->fill += n;
+    }
+  }
+
+  return r->fill - r->pos;
+}
+
+static void reader_skip(reader_t *r, unsigned long n) {
+  while (n > 0) {
+    unsigned long avail = r->fill - r->pos;
+    if (avail >= n) {
+      r->pos += n;
+      return;
+    }
+    n -= avail;
+    r->pos = r->fill;
+    if (reader_fill(r, n) == 0) {
+      return;
+    }
+  }
+}
+
+/*
+ * Tags
+ */
+
+// append code point c to the UTF-8 in out, unless it doesn't fit
+static bool put_utf8(char *out, unsigned long *n, unsigned long c) {
+  unsigned char bytes[4];
+  unsigned int len;
+
+  if (c < 0x80) {
+    bytes[0] = c;
+    len = 1;
+  } else if (c < 0x800) {
+    bytes[0] = 0xc0 | (c >> 6);
+    bytes[1] = 0x80 | (c & 0x3f);
+    len = 2;
+  } else if (c < 0x10000) {
+    bytes[0] = 0xe0 | (c >> 12);
+    bytes[1] = 0x80 | ((c >> 6) & 0x3f);
+    bytes[2] = 0x80 | (c & 0x3f);
+    len = 3;
+  } else {
+    bytes[0] = 0xf0 | (c >> 18);
+    bytes[1] = 0x80 | ((c >> 12) & 0x3f);
+    bytes[2] = 0x80 | ((c >> 6) & 0x3f);
+    bytes[3] = 0x80 | (c & 0x3f);
+    len = 4;
+  }
+
+  if (*n + len >= SCAN_TEXT_SIZE) {
+    return false;
+  }
+  memcpy(out + *n, bytes, len);
+  *n += len;
+  return true;
+}
+
+// the first string of an ID3 text frame, or of an ID3v1 field when encoding is 0,
+// as UTF-8 without trailing spaces
+static void scan_text(char out[SCAN_TEXT_SIZE], unsigned int encoding, unsigned char const *p, unsigned long len) {
+  unsigned long n = 0, i = 0;
+  bool big_endian = (encoding == 2);
+
+  if (encoding == 1 && len >= 2) {
+    // byte order mark
+    big_endian = (p[0] == 0xfe && p[1] == 0xff);
+    i = 2;
+  }
+
+  while (i < len) {
+    unsigned long c;
+
+    if (encoding == 1 || encoding == 2) {
+      if (i + 2 > len) {
+        break;
+      }
+      c = big_endian ? (p[i] << 8) | p[i + 1] : p[i] | (p[i + 1] << 8);
+      i += 2;
+      if (c >= 0xd800 && c < 0xdc00 && i + 2 <= len) {
+        unsigned long low = big_endian ? (p[i] << 8) | p[i + 1] : p[i] | (p[i + 1] << 8);
+        if (low >= 0xdc00 && low < 0xe000) {
+          c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+          i += 2;
+        }
+      }
+    } else {
+      // ISO-8859-1 maps straight to code points, UTF-8 is copied through
+      c = p[i++];
+    }
+
+    if (c == 0) {
+      break;
+    }
+    if (encoding == 3) {
+      if (n + 1 >= SCAN_TEXT_SIZE) {
+        break;
+      }
+      out[n++] = c;
+    } else if (!put_utf8(out, &n, c)) {
+      break;
+    }
+  }
+
+  // don't leave half a UTF-8 sequence behind when it was cut short
+  if (encoding == 3 && i < len && p[i] != 0) {
+    while (n > 0 && ((unsigned char)out[n - 1] & 0xc0) == 0x80) {
+      n--;
+    }
+    if (n > 0 && ((unsigned char)out[n - 1] & 0xc0) == 0xc0) {
+      n--;
+    }
+  }
+
+  while (n > 0 && out[n - 1] == ' ') {
+    n--;
+  }
+  out[n] = 0;
+}
+
+static int tag_index(unsigned char const *id, unsigned int version) {
+  static char const ids[][2][5] = {
+    [SCAN_TITLE]  = { "TT2", "TIT2" },
+    [SCAN_ARTIST] = { "TP1", "TPE1" },
+    [SCAN_ALBUM]  = { "TAL", "TALB" },
+    [SCAN_YEAR]   = { "TYE", "TYER" },
+    [SCAN_TRACK]  = { "TRK", "TRCK" },
+    [SCAN_GENRE]  = { "TCO", "TCON" },
+  };
+  unsigned int v = (version == 2) ? 0 : 1;
+
+  for (int i = 0; i < SCAN_TAGS; i++) {
+    if (same(id, ids[i][v], v ? 4 : 3)) {
+      return i;
+    }
+  }
+  // ID3v2.4 has the recording time instead of the year
+  if (version == 4 && same(id, "TDRC", 4)) {
+    return SCAN_YEAR;
+  }
+  return -1;
+}
+
+// the ID3v2 tags at the start of the stream
+static void scan_id3v2(scan_info_t *info, reader_t *r) {
+  while (reader_fill(r, 10) >= 10 && same(r->buf + r->pos, "ID3", 3)) {
+    unsigned char const *h = r->buf + r->pos;
+    unsigned int version = h[3], flags = h[5];
+    unsigned long size = syncsafe(h + 6);
+    unsigned int header_len = (version == 2) ? 6 : 10;
+
+    r->pos += 10;
+    if (version < 2 || version > 4) {
+      reader_skip(r, size);
+      continue;
+    }
+
+    // the extended header's size counts itself in ID3v2.4 but not in ID3v2.3
+    if (version >= 3 && (flags & 0x40) && reader_fill(r, 4) >= 4) {
+      unsigned long ext = (version == 4) ? syncsafe(r->buf + r->pos) : be32(r->buf + r->pos) + 4;
+      if (ext > size) {
+        ext = size;
+      }
+      reader_skip(r, ext);
+      size -= ext;
+    }
+
+    while (size >= header_len && reader_fill(r, header_len) >= header_len) {
+      unsigned char const *f = r->buf + r->pos;
+      unsigned long frame_size;
+      unsigned int frame_flags = 0, skip = 0;
+      int which;
+
+      if (f[0] == 0) {
+        // padding
+        break;
+      }
+      if (version == 2) {
+        frame_size = ((unsigned long)f[3] << 16) | (f[4] << 8) | f[5];
+      } else {
+        frame_size = (version == 4) ? syncsafe(f + 4) : be32(f + 4);
+        frame_flags = f[9];
+      }
+      which = tag_index(f, version);
+
+      r->pos += header_len;
+      size -= header_len;
+      if (frame_size > size) {
+        frame_size = size;
+      }
+
+      // compressed or encrypted frames aren't worth the trouble, grouping and
+      // the ID3v2.4 data length add bytes in front of the text
+      if (version == 3) {
+        if (frame_flags & 0xc0) {
+          which = -1;
+        }
+        skip = (frame_flags & 0x20) ? 1 : 0;
+      } else if (version == 4) {
+        if (frame_flags & 0x0c) {
+          which = -1;
+        }
+        skip = ((frame_flags & 0x40) ? 1 : 0) + ((frame_flags & 0x01) ? 4 : 0);
+      }
+
+      if (which >= 0 && info->tag[which][0] == 0 && frame_size > skip + 1) {
+        unsigned long len = frame_size;
+        unsigned long avail = reader_fill(r, len);
+        if (len > avail) {
+          len = avail;
+        }
+        if (len > skip + 1) {
+          unsigned char const *text = r->buf + r->pos + skip;
+          scan_text(info->tag[which], text[0], text + 1, len - skip - 1);
+        }
+      }
+
+      reader_skip(r, frame_size);
+      size -= frame_size;
+    }
+
+    // the rest of the padding, and the footer
+    reader_skip(r, size + ((version == 4 && (flags & 0x10)) ? 10 : 0));
+  }
+}
+
+/*
+ * NAME:	scan->id3v1()
+ * DESCRIPTION:	fill in the tags still missing from the ID3v1 tag in the
+ *		last 128 bytes of a stream, if it has one
+ */
+void scan_id3v1(scan_info_t *info, unsigned char const tail[128])
+{
+  static unsigned char const fields[][3] = {
+    { SCAN_TITLE, 3, 30 },
+    { SCAN_ARTIST, 33, 30 },
+    { SCAN_ALBUM, 63, 30 },
+    { SCAN_YEAR, 93, 4 },
+  };
+
+  if (!same(tail, "TAG", 3)) {
+    return;
+  }
+
+  for (unsigned int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    if (info->tag[fields[i][0]][0] == 0) {
+      scan_text(info->tag[fields[i][0]], 0, tail + fields[i][1], fields[i][2]);
+    }
+  }
+
+  // ID3v1.1 puts the track number at the end of the comment
+  if (info->tag[SCAN_TRACK][0] == 0 && tail[125] == 0 && tail[126] != 0) {
+    unsigned long n = 0;
+    unsigned int track = tail[126];
+    if (track >= 100) {
+      put_utf8(info->tag[SCAN_TRACK], &n, '0' + track / 100);
+    }
+    if (track >= 10) {
+      put_utf8(info->tag[SCAN_TRACK], &n, '0' + track / 10 % 10);
+    }
+    put_utf8(info->tag[SCAN_TRACK], &n, '0' + track % 10);
+    info->tag[SCAN_TRACK][n] = 0;
+  }
+
+  // the genre number, written the way ID3v2.3 refers to it
+  if (info->tag[SCAN_GENRE][0] == 0 && tail[127] != 0xff) {
+    unsigned long n = 0;
+    unsigned int genre = tail[127];
+    put_utf8(info->tag[SCAN_GENRE], &n, '(');
+    if (genre >= 100) {
+      put_utf8(info->tag[SCAN_GENRE], &n, '0' + genre / 100);
+    }
+    if (genre >= 10) {
+      put_utf8(info->tag[SCAN_GENRE], &n, '0' + genre / 10 % 10);
+    }
+    put_utf8(info->tag[SCAN_GENRE], &n, '0' + genre % 10);
+    put_utf8(info->tag[SCAN_GENRE], &n, ')');
+    info->tag[SCAN_GENRE][n] = 0;
+  }
+}
+
+/*
+ * Frames
+ */
+
+// the frame count (and byte count) from a Xing, Info or VBRI header in the
+// first frame, which encoders write as a frame of silence in front of the
+// audio, returns false without one
+static bool scan_xing(scan_info_t *info, struct mad_header const *header,
+                      unsigned char const *frame, unsigned long len, unsigned long *bytes) {
+  unsigned long side, offset;
+  unsigned char const *p;
+
+  if (header->layer != MAD_LAYER_III) {
+    return false;
+  }
+
+  // the tag takes the place of the main data, after the side information
+  if (header->flags & MAD_FLAG_LSF_EXT) {
+    side = (MAD_NCHANNELS(header) == 1) ? 9 : 17;
+  } else {
+    side = (MAD_NCHANNELS(header) == 1) ? 17 : 32;
+  }
+  offset = 4 + ((header->flags & MAD_FLAG_PROTECTION) ? 2 : 0) + side;
+
+  if (offset + 16 <= len && (same(frame + offset, "Xing", 4) || same(frame + offset, "Info", 4))) {
+    unsigned long flags = be32(frame + offset + 4);
+    p = frame + offset + 8;
+    if (!(flags & 0x0001)) {
+      return false;
+    }
+    info->frames = be32(p);
+    p += 4;
+    *bytes = (flags & 0x0002) && p + 4 <= frame + len ? be32(p) : 0;
+    info->vbr = same(frame + offset, "Xing", 4);
+    return true;
+  }
+
+  // the Fraunhofer encoder's, always 32 bytes in
+  offset = 4 + 32;
+  if (offset + 18 <= len && same(frame + offset, "VBRI", 4)) {
+    *bytes = be32(frame + offset + 10);
+    info->frames = be32(frame + offset + 14);
+    info->vbr = true;
+    return true;
+  }
+
+  return false;
+}
+
+// bytes over ms as bits per second, without 64-bit division
+static unsigned long bits_per_second(unsigned long bytes, unsigned long ms) {
+  unsigned long bits = bytes * 8;
+  unsigned long bps = bits / ms, rem = bits % ms;
+
+  for (int i = 0; i < 3; i++) {
+    rem *= 10;
+    bps = bps * 10 + rem / ms;
+    rem %= ms;
+  }
+  return bps;
+}
+
+static void scan_frames(scan_info_t *info, reader_t *r) {
+  struct mad_stream stream;
+  struct mad_header header;
+  mad_timer_t duration = mad_timer_zero;
+  unsigned long bytes = 0, first_bitrate = 0;
+  bool first = true, last = false;
+
+  mad_stream_init(&stream, r->buf);
+
+  while (!last) {
+    unsigned long avail = reader_fill(r, r->size);
+
+    // the last frame needs MAD_BUFFER_GUARD bytes after it to decode
+    if (r->eof) {
+      memset(r->buf + r->fill, 0, MAD_BUFFER_GUARD);
+      avail += MAD_BUFFER_GUARD;
+      last = true;
+    }
+    mad_stream_buffer(&stream, r->buf + r->pos, avail);
+
+    while (1) {
+      if (mad_header_decode(&header, &stream) == -1) {
+        if (!MAD_RECOVERABLE(stream.error)) {
+          break;
+        }
+        continue;
+      }
+
+      if (first) {
+        first = false;
+        info->samplerate = header.samplerate;
+        info->channels = MAD_NCHANNELS(&header);
+        info->layer = header.layer;
+        first_bitrate = header.bitrate;
+
+        if (scan_xing(info, &header, stream.this_frame, stream.next_frame - stream.this_frame, &bytes)) {
+          info->xing = true;
+          duration = header.duration;
+          mad_timer_multiply(&duration, info->frames);
+          info->duration_ms = mad_timer_count(duration, MAD_UNITS_MILLISECONDS);
+          if (bytes && info->duration_ms) {
+            info->bitrate = bits_per_second(bytes, info->duration_ms);
+          } else {
+            info->bitrate = header.bitrate;
+          }
+          return;
+        }
+      }
+
+      if (header.bitrate != first_bitrate) {
+        info->vbr = true;
+      }
+      info->frames++;
+      bytes += stream.next_frame - stream.this_frame;
+      mad_timer_add(&duration, header.duration);
+    }
+
+    // keep the frame that didn't fit for the next round
+    if (stream.next_frame == r->buf + r->pos && avail >= r->size) {
+      // a frame bigger than the buffer, which can only be garbage
+      r->pos++;
+    } else {
+      r->pos = stream.next_frame - r->buf;
+    }
+    if (r->pos > r->fill) {
+      r->pos = r->fill;
+    }
+  }
+
+  info->duration_ms = mad_timer_count(duration, MAD_UNITS_MILLISECONDS);
+  if (info->duration_ms) {
+    info->bitrate = bits_per_second(bytes, info->duration_ms);
+  }
+
+  mad_stream_finish(&stream);
+}
+
+/*
+ * NAME:	scan->stream()
+ * DESCRIPTION:	read a stream through read() with the size byte buffer buf
+ *		(at least SCAN_BUF_MIN bytes) and fill in info, returns 0,
+ *		or -1 if no MPEG audio frames were found
+ */
+int scan_stream(scan_info_t *info, scan_read_t read, void *ctx, unsigned char *buf, unsigned long size)
+{
+  reader_t r;
+
+  memset(info, 0, sizeof(*info));
+
+  r.read = read;
+  r.ctx = ctx;
+  r.buf = buf;
+  r.size = size - MAD_BUFFER_GUARD;
+  r.pos = 0;
+  r.fill = 0;
+  r.eof = false;
+  r.total = 0;
+
+  scan_id3v2(info, &r);
+  scan_frames(info, &r);
+
+  if (r.eof) {
+    info->at_end = true;
+    if (r.total >= sizeof(r.tail)) {
+      scan_id3v1(info, r.tail);
+    }
+  }
+
+  return (info->samplerate == 0) ? -1 : 0;
+}
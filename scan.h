@@ -0,0 +1,50 @@
+/*
+ * Reading the duration, bitrate and tags of an mp3 without decoding it,
+ * see scan.c
+ */
+
+#ifndef MPY_LIBMAD_SCAN_H
+#define MPY_LIBMAD_SCAN_H
+
+#include <stdbool.h>
+
+#include "libmad/mad.h"
+
+// read buffer, it has to hold the largest frame (2881 bytes, free format Layer III at 640kbps)
+// and the guard bytes after it
+#define SCAN_BUF_SIZE 4096
+#define SCAN_BUF_MIN  (2881 + MAD_BUFFER_GUARD)
+
+// bytes of UTF-8 kept of each tag, with the terminating 0
+#define SCAN_TEXT_SIZE 64
+
+enum {
+  SCAN_TITLE,
+  SCAN_ARTIST,
+  SCAN_ALBUM,
+  SCAN_YEAR,
+  SCAN_TRACK,
+  SCAN_GENRE,
+  SCAN_TAGS
+};
+
+typedef struct {
+  unsigned long frames;       // audio frames
+  unsigned long duration_ms;
+  unsigned long bitrate;      // average bits per second
+  unsigned int samplerate;
+  unsigned int channels;
+  unsigned int layer;
+  bool vbr;                   // the bitrate changes from frame to frame
+  bool xing;                  // frames comes from a Xing, Info or VBRI header, not from walking them
+  bool at_end;                // the whole stream was read, and any ID3v1 tag looked at
+  char tag[SCAN_TAGS][SCAN_TEXT_SIZE];  // empty when missing
+} scan_info_t;
+
+// read up to len bytes into buf, returns 0 at the end of the stream
+typedef unsigned long (*scan_read_t)(void *ctx, unsigned char *buf, unsigned long len);
+
+int scan_stream(scan_info_t *info, scan_read_t read, void *ctx, unsigned char *buf, unsigned long size);
+void scan_id3v1(scan_info_t *info, unsigned char const tail[128]);
+
+#endif // MPY_LIBMAD_SCAN_H
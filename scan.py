@@ -0,0 +1,123 @@
+"""
+library scanning: duration, bitrate, sample rate and tags of many mp3 files
+without decoding them, for building an index.
+
+mplibmad.scan() does one file in native code, reading the ID3v2 tag, then
+only the frame headers, and stopping at the first frame when it carries a
+Xing, Info or VBRI header with the frame count. This fans it out over a pool
+of worker threads started with _thread: each has its own read buffer, and
+the file reads are where a port with a GIL (unix) lets the others run.
+
+    for info in scan.scan_tree("/sd/music", workers=4):
+        print(info.path, info.duration_ms, info.artist, info.title)
+
+Entries that can't be opened or read, or hold no MPEG audio, come back as
+None, and the scan carries on with the next one.
+"""
+import os
+import time
+
+try:
+    from collections import namedtuple
+except ImportError:
+    from ucollections import namedtuple
+
+try:
+    import _thread
+except ImportError:
+    _thread = None
+
+import mplibmad
+
+Info = namedtuple("Info", (
+    "path", "duration_ms", "bitrate", "samplerate", "channels", "layer", "frames", "vbr",
+    "title", "artist", "album", "year", "track", "genre"))
+
+
+def scan_file(item, buf=None):
+    """Info for a path or an open stream, None if it isn't an mp3."""
+    if isinstance(item, str):
+        with open(item, "rb") as f:
+            return _scan(f, buf, item)
+    return _scan(item, buf, None)
+
+
+def _scan(stream, buf, path):
+    record = mplibmad.scan(stream, buf, _tail(stream))
+    if record is None:
+        return None
+    return Info(path, *record)
+
+
+def _tail(stream):
+    # the last 128 bytes, for an ID3v1 tag when the scan stops at a Xing header,
+    # if the stream can seek
+    try:
+        pos = stream.seek(0, 1)
+        stream.seek(-128, 2)
+        tail = stream.read(128)
+        stream.seek(pos)
+        return tail
+    except Exception:
+        return None
+
+
+def scan(items, workers=4):
+    """Info for each path or stream in items, in order, scanned by up to workers threads."""
+    items = list(items)
+    results = [None] * len(items)
+    if _thread is None:
+        workers = 1
+    workers = max(1, min(workers, len(items)))
+
+    lock = _thread.allocate_lock() if _thread else None
+    state = {'next': 0, 'running': workers - 1}
+
+    def work():
+        buf = bytearray(mplibmad.SCAN_BUF_SIZE)
+        while True:
+            if lock:
+                with lock:
+                    i = state['next']
+                    state['next'] += 1
+            else:
+                i = state['next']
+                state['next'] += 1
+            if i >= len(items):
+                break
+            try:
+                results[i] = scan_file(items[i], buf)
+            except Exception:
+                results[i] = None
+
+    def helper():
+        try:
+            work()
+        finally:
+            with lock:
+                state['running'] -= 1
+
+    for _ in range(workers - 1):
+        _thread.start_new_thread(helper, ())
+    work()
+    while state['running']:
+        time.sleep_ms(1)
+
+    return results
+
+
+def walk(root, suffix=".mp3"):
+    """Paths of the files under root ending in suffix, any case."""
+    suffix = suffix.lower()
+    for entry in os.ilistdir(root):
+        path = root.rstrip("/") + "/" + entry[0]
+        if entry[1] & 0x4000:
+            for sub in walk(path, suffix):
+                yield sub
+        elif entry[0].lower().endswith(suffix):
+            yield path
+
+
+def scan_tree(root, workers=4, suffix=".mp3"):
+    """Info for every mp3 under root, None entries left out."""
+    return [info for info in scan(walk(root, suffix), workers) if info is not None]
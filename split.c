@@ -0,0 +1,114 @@
+/*
+ * Splitting an mp3 stream at frame boundaries
+ *
+ * split_scan() walks the frame headers of a whole stream in memory, the
+ * same way the decoder finds its frames, and split_chunks() cuts the frame
+ * list into chunks that can be decoded on their own, e.g. on different
+ * cores, and stitched back together bit for bit.
+ *
+ * A chunk can't just start decoding at its first frame, as three things
+ * carry over from earlier frames:
+ *   - the Layer III bit reservoir: a frame's main data can start up to 511
+ *     bytes back, in the frames before it
+ *   - the IMDCT overlap: a Layer III frame's subband samples add in the
+ *     second half of the previous frame's IMDCT output
+ *   - the synthesis filterbank, which works on the last 16 rows of subband
+ *     samples, more than a 12 row Layer I frame
+ * So a frame's output is exact once the two frames before it decode exactly,
+ * and those do once the reservoir they draw on has been read. Each chunk
+ * starts that far back and throws the output of the warm-up frames away.
+ * No state depends on the synthesis phase, so it may start at any frame.
+ *
+ * This file only uses libmad, so it is shared by the module and the host
+ * tools in host/.
+ */
+#include "split.h"
+
+// most a frame spends on its header, CRC and Layer III side information
+#define SPLIT_FRAME_OVERHEAD (4 + 2 + 32)
+
+// the frames before the one that has to decode exactly
+#define SPLIT_HISTORY 2
+
+// byte offsets of up to max frames of buf in offset (which can be NULL
+// to just count them), returns the number of frames
+unsigned long split_scan(unsigned char const *buf, unsigned long len, unsigned long *offset, unsigned long max) {
+  struct mad_stream stream;
+  struct mad_header header;
+  unsigned long frames = 0;
+
+  // libmad only reads through the stream buffer
+  mad_stream_init(&stream, (unsigned char *)buf);
+  mad_stream_buffer(&stream, (unsigned char *)buf, len);
+
+  while (1) {
+    if (mad_header_decode(&header, &stream) == -1) {
+      if (stream.error != MAD_ERROR_BUFLEN) {
+        if (MAD_RECOVERABLE(stream.error)) {
+          continue;
+        }
+        break;
+      }
+
+      // the last frame fits, there just aren't MAD_BUFFER_GUARD bytes after it
+      if (stream.next_frame != stream.this_frame || stream.need <= MAD_BUFFER_GUARD ||
+          stream.need - MAD_BUFFER_GUARD > (unsigned long)(stream.bufend - stream.this_frame)) {
+        break;
+      }
+      stream.next_frame = stream.bufend;
+    }
+
+    if (offset != NULL && frames < max) {
+      offset[frames] = stream.this_frame - buf;
+    }
+    frames++;
+  }
+
+  mad_stream_finish(&stream);
+
+  return frames;
+}
+
+// the frame to start decoding at for frame k to come out exact
+static unsigned long split_warmup(unsigned long const *offset, unsigned long k) {
+  unsigned long j, reservoir = 0;
+
+  if (k <= SPLIT_HISTORY) {
+    return 0;
+  }
+  j = k - SPLIT_HISTORY;
+
+  // walk back over enough main data for the first frame of the history
+  while (j > 0 && reservoir < 511) {
+    unsigned long size = offset[j] - offset[j - 1];
+    j--;
+    if (size > SPLIT_FRAME_OVERHEAD) {
+      reservoir += size - SPLIT_FRAME_OVERHEAD;
+    }
+  }
+
+  return j;
+}
+
+// cut the frames of a len byte stream found by split_scan() into up to count
+// chunks of about the same number of frames, returns the number of chunks
+unsigned int split_chunks(unsigned long const *offset, unsigned long frames, unsigned long len,
+                          unsigned int count, split_chunk_t *chunk) {
+  unsigned int n = 0;
+
+  if (count > frames) {
+    count = frames;
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned long k = frames * i / count;
+    unsigned long e = frames * (i + 1) / count;
+
+    chunk[n].start = offset[split_warmup(offset, k)];
+    chunk[n].first = offset[k];
+    chunk[n].end = (e < frames) ? offset[e] : len;
+    n++;
+  }
+
+  return n;
+}
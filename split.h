@@ -0,0 +1,21 @@
+/*
+ * Splitting an mp3 stream at frame boundaries into chunks that can be
+ * decoded independently, see split.c
+ */
+
+#ifndef MPY_LIBMAD_SPLIT_H
+#define MPY_LIBMAD_SPLIT_H
+
+#include "libmad/mad.h"
+
+typedef struct {
+  unsigned long start;  // decode from here, the frames before first only warm the decoder up
+  unsigned long first;  // first frame whose output belongs to this chunk
+  unsigned long end;    // end of the chunk, the next chunk's first
+} split_chunk_t;
+
+unsigned long split_scan(unsigned char const *buf, unsigned long len, unsigned long *offset, unsigned long max);
+unsigned int split_chunks(unsigned long const *offset, unsigned long frames, unsigned long len,
+                          unsigned int count, split_chunk_t *chunk);
+
+#endif // MPY_LIBMAD_SPLIT_H
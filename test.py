@@ -113,6 +113,349 @@ def test_new_object_with_callbacks():
     print(dir(decoder))
     return True
 
+@test_decorator
+def test_prefetch():
+    # reading through the read-ahead ring should give back the file unchanged
+    import prefetch
+    with open("test/test.mp3", "rb") as f:
+        expected = f.read()
+    got = bytearray()
+    buf = bytearray(1500)
+    with open("test/test.mp3", "rb") as f:
+        with prefetch.Prefetcher(f, depth=3, block_size=1024) as pf:
+            while True:
+                n = pf.input(None, None, buf)
+                if n == 0:
+                    break
+                got.extend(buf[:n])
+            stats = pf.stats()
+    print(f"prefetch stats: {stats}")
+    assert got == expected, "prefetched data should match the file"
+    assert stats['reads'] == (len(expected) + 1023) // 1024, "should read whole blocks"
+    return True
+
+@test_decorator
+def test_prefetch_decode():
+    # decoding through the read-ahead ring should give the same pcm as from_buffer()
+    import prefetch
+
+    def pcm_sum(decoder, data):
+        pcm = decoder.get_pcm()
+        data['frames'] += 1
+        data['sum'] = (data['sum'] + sum(pcm.left)) & 0xffffffff
+        return mplibmad.MAD_FLOW_CONTINUE
+
+    with open("test/test.mp3", "rb") as f:
+        whole = {'frames': 0, 'sum': 0}
+        decoder = mplibmad.Decoder(cb_data=whole, output=pcm_sum)
+        decoder.from_buffer(f.read())
+        assert decoder.run() == 0, "decoding should succeed"
+
+    data = {'frames': 0, 'sum': 0}
+    with open("test/test.mp3", "rb") as f:
+        with prefetch.Prefetcher(f, depth=4, block_size=1024) as pf:
+            decoder = mplibmad.Decoder(cb_data=data, input=pf.input, output=pcm_sum)
+            assert decoder.run() == 0, "decoding should succeed"
+        assert pf.reader_done, "stop() should wait for the reader"
+    print(f"prefetch decode frames, sum: {(data['frames'], data['sum'])}")
+    assert (data['frames'], data['sum']) == (whole['frames'], whole['sum']), "prefetched decode should match"
+    return True
+
+@test_decorator
+def test_pipeline():
+    # two stage decoding should give the same pcm as run()
+    import pipeline
+
+    def pcm_sum(decoder, data):
+        pcm = decoder.get_pcm()
+        data['frames'] += 1
+        data['sum'] = (data['sum'] + sum(pcm.left)) & 0xffffffff
+        return mplibmad.MAD_FLOW_CONTINUE
+
+    sums = []
+    for depth, split in ((0, False), (2, False), (1, True)):
+        with open("test/test.mp3", "rb") as f:
+            data = {'frames': 0, 'sum': 0}
+            decoder = mplibmad.Decoder(cb_data=data, output=pcm_sum)
+            decoder.from_buffer(f.read())
+            result = decoder.run() if depth == 0 else pipeline.run(decoder, depth, split)
+            assert result == 0, "decoding should succeed"
+            sums.append((data['frames'], data['sum']))
+    print(f"pipeline frames, sum: {sums}")
+    assert sums[0] == sums[1] == sums[2], "pipeline output should match run()"
+    return True
+
+@test_decorator
+def test_split():
+    # chunks from split(), decoded on their own threads and joined, should match one run()
+    import _thread
+    import time
+
+    def pcm_sum(decoder, data):
+        pcm = decoder.get_pcm()
+        data['frames'] += 1
+        data['sum'] = (data['sum'] + sum(pcm.left)) & 0xffffffff
+        return mplibmad.MAD_FLOW_CONTINUE
+
+    def decode(buf, first, data):
+        decoder = mplibmad.Decoder(cb_data=data, output=pcm_sum)
+        decoder.from_buffer(buf, first)
+        data['result'] = decoder.run()
+
+    with open("test/test.mp3", "rb") as f:
+        buf = f.read()
+
+    whole = {'frames': 0, 'sum': 0}
+    decode(buf, 0, whole)
+
+    chunks = mplibmad.split(buf, 4)
+    print(f"split chunks: {chunks}")
+    assert len(chunks) == 4, "there should be 4 chunks"
+    results = [{'frames': 0, 'sum': 0, 'result': None} for _ in chunks]
+    for i, (start, first, end) in enumerate(chunks):
+        args = (memoryview(buf)[start:end], first - start, results[i])
+        if i < len(chunks) - 1:
+            _thread.start_new_thread(decode, args)
+        else:
+            decode(*args)
+    while any(r['result'] is None for r in results):
+        time.sleep_ms(1)
+
+    frames = sum(r['frames'] for r in results)
+    total = sum(r['sum'] for r in results) & 0xffffffff
+    print(f"split frames, sum: {(frames, total)}, whole: {(whole['frames'], whole['sum'])}")
+    assert frames == whole['frames'] and total == whole['sum'], "joined chunks should match run()"
+    return True
+
+@test_decorator
+def test_scan():
+    # header-only scanning should agree with itself from a path, a stream and bytes
+    import scan
+
+    with open("test/test.mp3", "rb") as f:
+        data = f.read()
+    with open("test/test.mp3", "rb") as f:
+        infos = scan.scan(["test/test.mp3", f, data], workers=2)
+    print(f"scan: {infos[0]}")
+    assert all(info is not None for info in infos), "test.mp3 should scan"
+    assert infos[0][1:] == infos[1][1:] == infos[2][1:], "all sources should give the same info"
+    info = infos[0]
+    # the Xing header's frame count, which leaves out the Xing frame itself
+    assert (info.frames, info.samplerate, info.channels, info.layer) == (2221, 44100, 2, 3)
+    assert info.duration_ms == 58017, "duration should come from the frame count"
+    assert mplibmad.scan(b"not an mp3") is None, "no frames should give None"
+    return True
+
+@test_decorator
+def test_stats():
+    # per-stage timing, only filled in when the module is built with -DMAD_STATS
+    with open("test/test.mp3", "rb") as f:
+        decoder = mplibmad.Decoder(output=lambda decoder, data: mplibmad.MAD_FLOW_CONTINUE)
+        decoder.from_buffer(f.read())
+        assert decoder.run() == 0, "decoding should succeed"
+    stats = decoder.stats()
+    print(f"stats: {stats}")
+    if stats:
+        assert stats['synth'][2] == 2222, "every frame should be synthesized once"
+        assert stats['output'][2] == 2222, "every frame should be output once"
+    return True
+
+def test_realtime():
+    # frames are only timed against their playing time with a deadline, off by default
+    with open("test/test.mp3", "rb") as f:
+        decoder = mplibmad.Decoder(output=lambda decoder, data: mplibmad.MAD_FLOW_CONTINUE)
+        decoder.from_buffer(f.read())
+        assert decoder.run() == 0, "decoding should succeed"
+        assert decoder.realtime()[3] == 0, "nothing is timed without a deadline"
+        decoder.reset(deadline=1)
+        assert decoder.run() == 0, "decoding should succeed"
+    rtf, worst_us, misses, frames = decoder.realtime()
+    print(f"realtime: rtf={rtf} worst_us={worst_us} misses={misses} frames={frames}")
+    assert frames == 2222, "every frame should be timed"
+    assert rtf >= 0 and worst_us > 0
+    try:
+        decoder.reset(deadline=-5)
+        assert False, "a negative deadline should fail"
+    except ValueError:
+        pass
+    return True
+
+@test_decorator
+def test_callback_raises():
+    # an exception from a callback leaves the decoder ready for reset() and the next run()
+    def output(decoder, data):
+        data['frames'] += 1
+        if data['raise'] and data['frames'] == 10:
+            raise OSError(5)
+        return mplibmad.MAD_FLOW_CONTINUE
+
+    data = {'frames': 0, 'raise': True}
+    with open("test/test.mp3", "rb") as f:
+        decoder = mplibmad.Decoder(cb_data=data, output=output)
+        decoder.from_buffer(f.read())
+    try:
+        decoder.run()
+        assert False, "the callback's exception should come out of run()"
+    except OSError:
+        pass
+    data['frames'] = 0
+    data['raise'] = False
+    decoder.reset()
+    assert decoder.run() == 0, "decoding should succeed after the exception"
+    assert data['frames'] == 2222, "every frame should be output"
+
+    # the same from a pipeline stage, left as it is without draining it
+    data['frames'] = 0
+    data['raise'] = True
+    decoder.reset()
+    decoder.pipeline(2)
+    try:
+        while True:
+            decoder.run_stage(mplibmad.STAGE_FRONT)
+            decoder.run_stage(mplibmad.STAGE_BACK)
+    except OSError:
+        pass
+    data['frames'] = 0
+    data['raise'] = False
+    decoder.reset()
+    assert decoder.run() == 0, "decoding should succeed after the stage's exception"
+    assert data['frames'] == 2222, "every frame should be output"
+    return True
+
+def test_quality():
+    # at half rate every frame comes out as 576 samples, and the level sticks across tracks
+    lengths = set()
+    def output(decoder, data):
+        lengths.add(decoder.get_pcm().length)
+        return mplibmad.MAD_FLOW_CONTINUE
+    with open("test/test.mp3", "rb") as f:
+        decoder = mplibmad.Decoder(output=output, governor=mplibmad.QUALITY_MONO)
+        assert decoder.quality() == mplibmad.QUALITY_FULL
+        decoder.quality(mplibmad.QUALITY_HALFRATE)
+        decoder.reset(governor=0)
+        decoder.from_buffer(f.read())
+        assert decoder.run() == 0, "decoding should succeed"
+    print(f"quality: level={decoder.quality()} lengths={lengths}")
+    assert decoder.quality() == mplibmad.QUALITY_HALFRATE
+    assert lengths == {576}, "half rate frames should have 576 samples"
+    try:
+        decoder.quality(7)
+        assert False, "an unknown level should fail"
+    except ValueError:
+        pass
+    return True
+
+def test_options():
+    # SSO and reduced rate synthesis decode every frame too, and unknown option bits are refused
+    with open("test/test.mp3", "rb") as f:
+        decoder = mplibmad.Decoder(output=lambda decoder, data: mplibmad.MAD_FLOW_CONTINUE,
+                                   options=mplibmad.MAD_OPTION_SSO, deadline=100)
+        decoder.from_buffer(f.read())
+        assert decoder.run() == 0, "decoding should succeed"
+    assert decoder.realtime()[3] == 2222, "every frame should be decoded"
+    lengths = set()
+    def output(decoder, data):
+        lengths.add(decoder.get_pcm().length)
+        return mplibmad.MAD_FLOW_CONTINUE
+    for option, length in ((mplibmad.MAD_OPTION_QUARTERSAMPLERATE, 288),
+                           (mplibmad.MAD_OPTION_EIGHTHSAMPLERATE, 144)):
+        lengths.clear()
+        with open("test/test.mp3", "rb") as f:
+            decoder = mplibmad.Decoder(output=output, options=option)
+            decoder.from_buffer(f.read())
+            assert decoder.run() == 0, "decoding should succeed"
+        assert lengths == {length}, "reduced rate frames should be shorter"
+    try:
+        decoder.reset(options=0x8000)
+        assert False, "an unknown option should fail"
+    except ValueError:
+        pass
+    return True
+
+@test_decorator
+def test_frame_views():
+    # get_pcm() and get_frame_header() hand out the same objects every frame, without allocating
+    import gc
+
+    def output(decoder, data):
+        pcm = decoder.get_pcm()
+        header = decoder.get_frame_header()
+        if data['frames'] == 0:
+            data['pcm'] = pcm
+            data['header'] = header
+            # the views are copies: writing one doesn't reach the decoder's samples
+            b = pcm.left[0]
+            pcm.left[0] = b ^ 0xff
+            data['copies'] = pcm.interleaved[0] == b
+        elif pcm is not data['pcm'] or header is not data['header']:
+            data['same'] = False
+        if len(pcm.left) != pcm.width * pcm.length or len(pcm.interleaved) != 2 * len(pcm.right):
+            data['sizes'] = False
+        data['bitrate'] = header.bitrate
+        data['frames'] += 1
+        if data['frames'] == 32:
+            data['alloc'] = gc.mem_alloc()
+        elif data['frames'] == 288:
+            data['alloc'] = gc.mem_alloc() - data['alloc']
+            return mplibmad.MAD_FLOW_STOP
+        return mplibmad.MAD_FLOW_CONTINUE
+
+    data = {'frames': 0, 'same': True, 'sizes': True, 'copies': False, 'alloc': 0, 'bitrate': 0}
+    with open("test/test.mp3", "rb") as f:
+        decoder = mplibmad.Decoder(cb_data=data, output=output)
+        decoder.from_buffer(f.read())
+        gc.collect()
+        gc.disable()
+        try:
+            assert decoder.run() == 0, "decoding should succeed"
+        finally:
+            gc.enable()
+    pcm, header = data['pcm'], data['header']
+    print(f"frame views: {pcm.channels} channels, {pcm.samplerate} Hz, layer {header.layer}, "
+          f"{data['bitrate']} bps, {header.duration_milliseconds} ms, {data['alloc']} bytes in 256 frames")
+    assert data['same'], "every frame should get the same views"
+    assert data['sizes'], "the views should cover the frame's samples"
+    assert data['copies'], "the views should be copies of the samples"
+    assert len(pcm.left) == pcm.width * pcm.length, "a kept view should hold the last frame"
+    assert data['alloc'] == 0, "reading the views should not allocate"
+    assert decoder.get_pcm() is None, "there's no frame outside of run()"
+    return True
+
+@test_decorator
+def test_pin_tables():
+    # decoding from the pinned copies should give the same pcm as from flash, and the
+    # copies should stay alive across a collection, held by the module, not by us
+    import gc
+
+    def pcm_sum(decoder, data):
+        pcm = decoder.get_pcm()
+        data['frames'] += 1
+        data['sum'] = (data['sum'] + sum(pcm.left) + sum(pcm.right)) & 0xffffffff
+        return mplibmad.MAD_FLOW_CONTINUE
+
+    with open("test/test.mp3", "rb") as f:
+        mp3 = f.read()
+
+    def decode():
+        data = {'frames': 0, 'sum': 0}
+        decoder = mplibmad.Decoder(cb_data=data, output=pcm_sum)
+        decoder.from_buffer(mp3)
+        assert decoder.run() == 0, "decoding should succeed"
+        return (data['frames'], data['sum'])
+
+    flash = decode()
+    size = mplibmad.pin_tables()
+    assert size > 0, "pinning should use some RAM"
+    assert '_pinned_tables' not in globals(), "the block belongs to the module, not the caller"
+    assert mplibmad._pinned_tables is not None, "the module should hold the block"
+    gc.collect()
+    pinned = decode()
+    assert mplibmad.pin_tables(0) == 0, "unpinning should free the block"
+    unpinned = decode()
+    print(f"pin_tables bytes {size}, frames, sum: {(flash, pinned, unpinned)}")
+    assert flash == pinned == unpinned, "the pinned tables should decode the same"
+    return True
+
 def run_tests():
     print("Start Test:")
     print(dir(mplibmad))
@@ -122,6 +465,18 @@ def run_tests():
     test_module_constants()
     test_new_object_should_fail()
     test_new_object_with_callbacks()
+    test_prefetch()
+    test_prefetch_decode()
+    test_pipeline()
+    test_split()
+    test_scan()
+    test_stats()
+    test_realtime()
+    test_callback_raises()
+    test_quality()
+    test_options()
+    test_frame_views()
+    test_pin_tables()
     print("Done.")
     
 if __name__ == "__main__":